@@ -52,6 +52,9 @@ static void media_suggest_cb(void* cookie, media_parcel* msg)
     int32_t event;
     int32_t ret;
 
+    if (!msg)
+        return;
+
     media_parcel_read_scanf(msg, "%i%i%s", &event, &ret, &extra);
     priv->on_suggestion(event, priv->cookie);
 }
@@ -30,12 +30,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include "media_common.h"
 #include "media_proxy.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_MEDIA_BUFFER_SOCKET_SIZE
+#define CONFIG_MEDIA_BUFFER_SOCKET_SIZE 0
+#endif
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -46,7 +56,6 @@ typedef struct MediaIOPriv {
     media_event_callback event;
     atomic_int refs;
     sem_t sem;
-    int socket_fd;
     int socket;
     int result;
 } MediaIOPriv;
@@ -116,8 +125,6 @@ static void media_close_socket(void* handle)
         socket = priv->socket;
         priv->socket = 0;
         close(socket);
-        if (priv->socket_fd > 0)
-            close(priv->socket_fd);
     }
 }
 
@@ -188,6 +195,18 @@ out:
     return -errno;
 }
 
+static void media_tune_socket(MediaIOPriv* priv)
+{
+    int opt = priv->type == MEDIA_ID_PLAYER ? SO_SNDBUF : SO_RCVBUF;
+    int size = CONFIG_MEDIA_BUFFER_SOCKET_SIZE;
+
+    /* Let a whole period fit in the local socket, so each write/read
+     * completes in one syscall instead of partial transfers and wakeups.
+     */
+    if (size > 0 && !strcmp(priv->cpu, CONFIG_RPMSG_LOCAL_CPUNAME))
+        setsockopt(priv->socket, SOL_SOCKET, opt, &size, sizeof(size));
+}
+
 static int media_prepare(void* handle, const char* url, const char* options)
 {
     MediaIOPriv* priv = handle;
@@ -220,25 +239,47 @@ static int media_prepare(void* handle, const char* url, const char* options)
         goto out;
 
     if (fd > 0) {
-        priv->socket_fd = fd;
         priv->socket = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
         if (priv->socket < 0) {
             priv->socket = 0;
             ret = -errno;
+            goto out;
         }
+
+        media_tune_socket(priv);
     }
 
 out:
+    /* Server connects only once, listener is useless after accept. */
+    if (fd > 0)
+        close(fd);
+
     return ret;
 }
 
+static ssize_t media_check_data(MediaIOPriv* priv, ssize_t ret)
+{
+    if (ret > 0)
+        return ret;
+    else if (ret == 0)
+        errno = ECONNRESET;
+    else if (errno == EINTR || errno == EAGAIN)
+        return -errno; /* Nothing moved, caller may try again. */
+
+    /* Peer closed or socket broken, drop it. */
+    close(priv->socket);
+    priv->socket = 0;
+    return -errno;
+}
+
 static ssize_t media_process_data(void* handle, bool player,
-    void* data, size_t len)
+    const struct iovec* iov, int iovcnt)
 {
     MediaIOPriv* priv = handle;
-    int ret = -EINVAL;
+    struct msghdr msg;
+    ssize_t ret = -EINVAL;
 
-    if (!handle || !data || !len)
+    if (!handle || !iov || iovcnt <= 0)
         return ret;
 
     atomic_fetch_add(&priv->refs, 1);
@@ -246,33 +287,38 @@ static ssize_t media_process_data(void* handle, bool player,
     if (priv->socket <= 0)
         goto out;
 
-    if (player) {
-        ret = send(priv->socket, data, len, 0);
-        if (ret == len)
-            goto out;
-        else if (ret == 0)
-            errno = ECONNRESET;
-        else if (ret < 0 && errno == EINTR) {
-            ret = -errno;
-            goto out;
-        }
-    } else {
-        ret = recv(priv->socket, data, len, 0);
-        if (ret > 0)
-            goto out;
-        else if (ret == 0)
-            errno = ECONNRESET;
-        else if (ret < 0 && errno == EINTR) {
-            ret = -errno;
-            goto out;
-        }
-    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec*)iov;
+    msg.msg_iovlen = iovcnt;
 
-    close(priv->socket);
-    priv->socket = 0;
-    if (priv->socket_fd > 0)
-        close(priv->socket_fd);
-    ret = -errno;
+    if (player)
+        ret = media_check_data(priv, sendmsg(priv->socket, &msg, 0));
+    else
+        ret = media_check_data(priv, recvmsg(priv->socket, &msg, 0));
+
+out:
+    media_release_cb(priv);
+    return ret;
+}
+
+static ssize_t media_process_file(void* handle, int fd, off_t* offset, size_t len)
+{
+    MediaIOPriv* priv = handle;
+    ssize_t ret = -EINVAL;
+
+    if (!handle || fd < 0 || !len)
+        return ret;
+
+    atomic_fetch_add(&priv->refs, 1);
+
+    if (priv->socket <= 0)
+        goto out;
+
+    /* Let kernel move file data to socket, no user space copy, might be
+     * short as write is; zero means end of file, not a closed peer. */
+    ret = sendfile(priv->socket, fd, offset, len);
+    if (ret != 0)
+        ret = media_check_data(priv, ret);
 
 out:
     media_release_cb(priv);
@@ -286,7 +332,7 @@ static void media_event_cb(void* cookie, media_parcel* msg)
     int32_t event;
     int32_t ret;
 
-    if (priv->event) {
+    if (msg && priv->event) {
         media_parcel_read_scanf(msg, "%i%i%s", &event, &ret, &extra);
         priv->event(priv->cookie, event, ret, extra);
     }
@@ -315,6 +361,31 @@ static int media_set_event_cb(void* handle, void* cookie,
     return ret;
 }
 
+static int media_set_watermark(void* handle, size_t watermark)
+{
+    char tmp[32];
+
+    snprintf(tmp, sizeof(tmp), "%zu", watermark);
+    return media_proxy_once(handle, NULL, "set_buffer_watermark", tmp, 0, NULL, 0);
+}
+
+static int media_get_buffer_status(void* handle, media_buffer_status_t* status)
+{
+    char tmp[64];
+    int ret;
+
+    if (!status)
+        return -EINVAL;
+
+    /* Format: "size:level:underruns", counted by the filter owning the queue. */
+    ret = media_proxy_once(handle, NULL, "get_buffer_status", NULL, 0, tmp, sizeof(tmp));
+    if (ret >= 0 && sscanf(tmp, "%zu:%zu:%u", &status->size, &status->level,
+                        &status->underruns) != 3)
+        ret = -EINVAL;
+
+    return ret;
+}
+
 static int media_get_socket(void* handle)
 {
     MediaIOPriv* priv = handle;
@@ -361,6 +432,22 @@ int media_player_prepare(void* handle, const char* url, const char* options)
     return media_prepare(handle, url, options);
 }
 
+int media_player_queue_next(void* handle, const char* url, const char* options)
+{
+    int ret;
+
+    if (!handle)
+        return -EINVAL;
+
+    if (options && options[0] != '\0') {
+        ret = media_proxy_once(handle, NULL, "set_next_options", options, 0, NULL, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    return media_proxy_once(handle, NULL, "queue_next", url, 0, NULL, 0);
+}
+
 int media_player_reset(void* handle)
 {
     if (!handle)
@@ -373,7 +460,32 @@ int media_player_reset(void* handle)
 
 ssize_t media_player_write_data(void* handle, const void* data, size_t len)
 {
-    return media_process_data(handle, true, (void*)data, len);
+    struct iovec iov = { (void*)data, len };
+
+    if (!data || !len)
+        return -EINVAL;
+
+    return media_process_data(handle, true, &iov, 1);
+}
+
+ssize_t media_player_writev(void* handle, const struct iovec* iov, int iovcnt)
+{
+    return media_process_data(handle, true, iov, iovcnt);
+}
+
+ssize_t media_player_write_fd(void* handle, int fd, off_t* offset, size_t len)
+{
+    return media_process_file(handle, fd, offset, len);
+}
+
+int media_player_set_buffer_watermark(void* handle, size_t low)
+{
+    return media_set_watermark(handle, low);
+}
+
+int media_player_get_buffer_status(void* handle, media_buffer_status_t* status)
+{
+    return media_get_buffer_status(handle, status);
 }
 
 int media_player_get_sockaddr(void* handle, struct sockaddr_storage* addr)
@@ -430,6 +542,14 @@ int media_player_set_looping(void* handle, int loop)
     return media_proxy_once(handle, NULL, "set_loop", tmp, 0, NULL, 0);
 }
 
+int media_player_set_progress_interval(void* handle, unsigned int interval)
+{
+    char tmp[32];
+
+    snprintf(tmp, sizeof(tmp), "%u", interval);
+    return media_proxy_once(handle, NULL, "set_progress", tmp, 0, NULL, 0);
+}
+
 int media_player_is_playing(void* handle)
 {
     char tmp[32];
@@ -519,6 +639,85 @@ int media_player_get_property(void* handle, const char* target, const char* key,
     return media_proxy_once(handle, target, key, NULL, 0, value, value_len);
 }
 
+void* media_player_open_sound_pool(const char* stream)
+{
+    return media_open(MEDIA_ID_PLAYER, stream);
+}
+
+int media_player_load_sound(void* pool, const char* url)
+{
+    if (!url || !url[0])
+        return -EINVAL;
+
+    return media_proxy_once(pool, NULL, "load_sound", url, 0, NULL, 0);
+}
+
+int media_player_play_sound(void* pool, int id)
+{
+    char tmp[32];
+
+    snprintf(tmp, sizeof(tmp), "%d", id);
+    return media_proxy_post(pool, NULL, "play_sound", tmp, 0);
+}
+
+int media_player_unload_sound(void* pool, int id)
+{
+    char tmp[32];
+
+    snprintf(tmp, sizeof(tmp), "%d", id);
+    return media_proxy_once(pool, NULL, "unload_sound", tmp, 0, NULL, 0);
+}
+
+int media_player_close_sound_pool(void* pool)
+{
+    return media_close(pool, 0);
+}
+
+#ifdef CONFIG_FS_SHMFS
+int media_player_get_status_count(void)
+{
+    const media_status_page_t* page = media_status_get_page();
+
+    return page ? page->nb : -ENOENT;
+}
+
+int media_player_get_status(int index, media_player_status_t* status)
+{
+    const media_status_record_t* record;
+    const media_status_page_t* page;
+    unsigned seq;
+
+    if (!status || index < 0)
+        return -EINVAL;
+
+    page = media_status_get_page();
+    if (!page)
+        return -ENOENT;
+
+    if (index >= page->nb)
+        return -EINVAL;
+
+    record = &page->records[index];
+    do {
+        seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        memcpy(status, &record->data, sizeof(*status));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&record->seq, memory_order_relaxed));
+
+    return status->id ? 0 : -ENOENT;
+}
+#else
+int media_player_get_status_count(void)
+{
+    return -ENOSYS;
+}
+
+int media_player_get_status(int index, media_player_status_t* status)
+{
+    return -ENOSYS;
+}
+#endif
+
 void* media_recorder_open(const char* params)
 {
     return media_open(MEDIA_ID_RECORDER, params);
@@ -552,7 +751,27 @@ int media_recorder_reset(void* handle)
 
 ssize_t media_recorder_read_data(void* handle, void* data, size_t len)
 {
-    return media_process_data(handle, false, data, len);
+    struct iovec iov = { data, len };
+
+    if (!data || !len)
+        return -EINVAL;
+
+    return media_process_data(handle, false, &iov, 1);
+}
+
+ssize_t media_recorder_readv(void* handle, const struct iovec* iov, int iovcnt)
+{
+    return media_process_data(handle, false, iov, iovcnt);
+}
+
+int media_recorder_set_buffer_watermark(void* handle, size_t high)
+{
+    return media_set_watermark(handle, high);
+}
+
+int media_recorder_get_buffer_status(void* handle, media_buffer_status_t* status)
+{
+    return media_get_buffer_status(handle, status);
 }
 
 int media_recorder_get_sockaddr(void* handle, struct sockaddr_storage* addr)
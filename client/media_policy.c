@@ -24,6 +24,8 @@
 
 #include <errno.h>
 #include <media_policy.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +33,18 @@
 #include "media_common.h"
 #include "media_proxy.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_MEDIA_POLICY_CACHE_ENTRIES
+#define CONFIG_MEDIA_POLICY_CACHE_ENTRIES 0
+#endif
+
+#define MEDIA_POLICY_CACHE_INT 0
+#define MEDIA_POLICY_CACHE_STRING 1
+#define MEDIA_POLICY_CACHE_CONTAIN 2
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -39,8 +53,40 @@ typedef struct MediaPolicyPriv {
     MEDIA_COMMON_FIELDS
     void* cookie;
     media_policy_change_callback on_change;
+    void (*on_lost)(void* cookie);
 } MediaPolicyPriv;
 
+#if CONFIG_MEDIA_POLICY_CACHE_ENTRIES > 0
+typedef struct MediaPolicyCacheEntry {
+    char name[64]; /* Empty if slot is free. */
+    void* handle; /* Subscription, NULL if failed or pending. */
+    bool pending; /* Being subscribed out of lock. */
+    unsigned seq; /* Bumped when the slot is freed. */
+    unsigned gen; /* Bumped on every change notification. */
+    bool has_number;
+    int number;
+    char* literal;
+    char* values; /* Last `contain` query and its result. */
+    int contain;
+} MediaPolicyCacheEntry;
+
+typedef struct MediaPolicyCache {
+    pthread_mutex_t lock;
+    int nb;
+    MediaPolicyCacheEntry entries[CONFIG_MEDIA_POLICY_CACHE_ENTRIES];
+} MediaPolicyCache;
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#if CONFIG_MEDIA_POLICY_CACHE_ENTRIES > 0
+static MediaPolicyCache g_media_policy_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+#endif
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
@@ -51,10 +97,271 @@ static void media_policy_change_cb(void* cookie, media_parcel* msg)
     const char* literal;
     int32_t number;
 
+    if (!msg) {
+        if (priv->on_lost)
+            priv->on_lost(priv->cookie);
+        return;
+    }
+
     media_parcel_read_scanf(msg, "%i%i%s", NULL, &number, &literal);
     priv->on_change(priv->cookie, number, literal);
 }
 
+static void* media_policy_subscribe_(const char* name,
+    media_policy_change_callback on_change, void (*on_lost)(void* cookie),
+    void* cookie)
+{
+    MediaPolicyPriv* priv;
+    int ret;
+
+    priv = calloc(1, sizeof(MediaPolicyPriv));
+    if (!priv)
+        return NULL;
+
+    priv->cookie = cookie;
+    priv->on_change = on_change;
+    priv->on_lost = on_lost;
+
+    ret = media_proxy(MEDIA_ID_POLICY, priv, NULL, "ping", NULL, 0, NULL, 0);
+    if (ret < 0) {
+        media_default_release_cb(priv);
+        return NULL;
+    }
+
+    media_proxy_set_release_cb(priv->proxy, media_default_release_cb, priv);
+    ret = media_proxy_set_event_cb(priv->proxy, priv->cpu, media_policy_change_cb, priv);
+    if (ret < 0)
+        goto err;
+
+    if (media_proxy_once(priv, name, "subscribe", NULL, 0, NULL, 0) < 0)
+        goto err;
+
+    return priv;
+
+err:
+    media_policy_unsubscribe(priv->proxy);
+    return NULL;
+}
+
+#if CONFIG_MEDIA_POLICY_CACHE_ENTRIES > 0
+static void media_policy_cache_reset(MediaPolicyCacheEntry* entry)
+{
+    entry->gen++;
+    entry->has_number = false;
+    free(entry->literal);
+    entry->literal = NULL;
+    free(entry->values);
+    entry->values = NULL;
+}
+
+static void media_policy_cache_change_cb(void* cookie, int number,
+    const char* literal)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+
+    pthread_mutex_lock(&cache->lock);
+    media_policy_cache_reset(cookie);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Subscription connection is gone, changes would be missed: flush the
+ * entry and free its slot, next get subscribes again. */
+static void media_policy_cache_lost_cb(void* cookie)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    MediaPolicyCacheEntry* entry = cookie;
+    MediaPolicyPriv* handle;
+
+    pthread_mutex_lock(&cache->lock);
+    handle = entry->handle;
+    media_policy_cache_reset(entry);
+    entry->handle = NULL;
+    entry->pending = false;
+    entry->name[0] = '\0';
+    entry->seq++;
+    pthread_mutex_unlock(&cache->lock);
+
+    /* Listener thread itself, disconnect detaches it. */
+    if (handle)
+        media_proxy_disconnect(handle->proxy);
+}
+
+/* Should be called with lock held. */
+static MediaPolicyCacheEntry* media_policy_cache_find(const char* name)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    int i;
+
+    for (i = 0; i < cache->nb; i++) {
+        if (!strcmp(cache->entries[i].name, name))
+            return &cache->entries[i];
+    }
+
+    return NULL;
+}
+
+/* Should be called with lock held, take a slot to subscribe `name`. */
+static MediaPolicyCacheEntry* media_policy_cache_add(const char* name)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    MediaPolicyCacheEntry* entry = NULL;
+    int i;
+
+    if (strlen(name) >= sizeof(entry->name))
+        return NULL;
+
+    for (i = 0; i < cache->nb; i++) {
+        if (!cache->entries[i].name[0]) {
+            entry = &cache->entries[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (cache->nb >= CONFIG_MEDIA_POLICY_CACHE_ENTRIES)
+            return NULL;
+
+        entry = &cache->entries[cache->nb++];
+    }
+
+    strcpy(entry->name, name);
+    entry->pending = true;
+    return entry;
+}
+
+/* Subscribe without lock: it's a blocking RPC, and its listener thread
+ * takes the lock to deliver changes. */
+static void media_policy_cache_subscribe(MediaPolicyCacheEntry* entry,
+    const char* name, unsigned seq)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    MediaPolicyPriv* handle;
+
+    handle = media_policy_subscribe_(name, media_policy_cache_change_cb,
+        media_policy_cache_lost_cb, entry);
+    if (!handle)
+        MEDIA_WARN("subscribe %s failed, not cached.\n", name);
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Keep the slot even on failure, so as not to subscribe again. */
+    if (entry->seq == seq) {
+        entry->handle = handle;
+        entry->pending = false;
+        handle = NULL;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    /* Lost before it was kept. */
+    if (handle)
+        media_proxy_disconnect(handle->proxy);
+}
+
+/* Return zero on hit, else fill the generation for media_policy_cache_put. */
+static int media_policy_cache_get(const char* name, int type,
+    const char* values, void* res, int len, unsigned* gen)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    MediaPolicyCacheEntry* entry;
+    int ret = -ENOENT;
+    unsigned seq;
+
+    if (!name || !name[0])
+        return ret;
+
+    pthread_mutex_lock(&cache->lock);
+
+    entry = media_policy_cache_find(name);
+    if (!entry) {
+        entry = media_policy_cache_add(name);
+        if (!entry)
+            goto out;
+
+        /* Subscribed before the caller reads the value, so a change after
+         * the read bumps `gen` and media_policy_cache_put drops it. */
+        *gen = entry->gen;
+        seq = entry->seq;
+        pthread_mutex_unlock(&cache->lock);
+        media_policy_cache_subscribe(entry, name, seq);
+        return ret;
+    }
+
+    if (!entry->handle)
+        goto out;
+
+    *gen = entry->gen;
+    if (type == MEDIA_POLICY_CACHE_INT && entry->has_number) {
+        *(int*)res = entry->number;
+        ret = 0;
+    } else if (type == MEDIA_POLICY_CACHE_STRING && entry->literal
+        && strlen(entry->literal) < len) {
+        strcpy(res, entry->literal);
+        ret = 0;
+    } else if (type == MEDIA_POLICY_CACHE_CONTAIN && entry->values
+        && values && !strcmp(entry->values, values)) {
+        *(int*)res = entry->contain;
+        ret = 0;
+    }
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+/* Keep the value read from mediad, unless it changed meanwhile. */
+static void media_policy_cache_put(const char* name, int type,
+    const char* values, const void* res, unsigned gen)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    MediaPolicyCacheEntry* entry;
+
+    if (!name || !name[0])
+        return;
+
+    pthread_mutex_lock(&cache->lock);
+
+    entry = media_policy_cache_find(name);
+    if (!entry || !entry->handle || entry->gen != gen)
+        goto out;
+
+    if (type == MEDIA_POLICY_CACHE_INT) {
+        entry->number = *(const int*)res;
+        entry->has_number = true;
+    } else if (type == MEDIA_POLICY_CACHE_STRING) {
+        free(entry->literal);
+        entry->literal = strdup(res);
+    } else if (type == MEDIA_POLICY_CACHE_CONTAIN && values) {
+        free(entry->values);
+        entry->values = strdup(values);
+        entry->contain = *(const int*)res;
+    }
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Drop own writes at once, instead of waiting for the notification. */
+static void media_policy_cache_invalidate(const char* name)
+{
+    MediaPolicyCache* cache = &g_media_policy_cache;
+    int i;
+
+    pthread_mutex_lock(&cache->lock);
+
+    for (i = 0; i < cache->nb; i++) {
+        if (!name || !strcmp(cache->entries[i].name, name))
+            media_policy_cache_reset(&cache->entries[i]);
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+#else
+#define media_policy_cache_get(name, type, values, res, len, gen) ((void)(gen), -ENOENT)
+#define media_policy_cache_put(name, type, values, res, gen) ((void)(gen))
+#define media_policy_cache_invalidate(name)
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -182,35 +489,7 @@ int media_policy_decrease_stream_volume(const char* stream)
 void* media_policy_subscribe(const char* name,
     media_policy_change_callback on_change, void* cookie)
 {
-    MediaPolicyPriv* priv;
-    int ret;
-
-    priv = calloc(1, sizeof(MediaPolicyPriv));
-    if (!priv)
-        return NULL;
-
-    priv->cookie = cookie;
-    priv->on_change = on_change;
-
-    ret = media_proxy(MEDIA_ID_POLICY, priv, NULL, "ping", NULL, 0, NULL, 0);
-    if (ret < 0) {
-        media_default_release_cb(priv);
-        return NULL;
-    }
-
-    media_proxy_set_release_cb(priv->proxy, media_default_release_cb, priv);
-    ret = media_proxy_set_event_cb(priv->proxy, priv->cpu, media_policy_change_cb, priv);
-    if (ret < 0)
-        goto err;
-
-    if (media_proxy_once(priv, name, "subscribe", NULL, 0, NULL, 0) < 0)
-        goto err;
-
-    return priv;
-
-err:
-    media_policy_unsubscribe(priv->proxy);
-    return NULL;
+    return media_policy_subscribe_(name, on_change, NULL, cookie);
 }
 
 int media_policy_unsubscribe(void* handle)
@@ -228,25 +507,68 @@ int media_policy_unsubscribe(void* handle)
     return media_proxy_disconnect(priv->proxy);
 }
 
+int media_policy_get_status(const char* name, media_policy_status_t* status)
+{
+#ifdef CONFIG_FS_SHMFS
+    const media_status_criterion_t* criterion;
+    const media_status_page_t* page;
+    unsigned seq;
+    int i;
+
+    if (!name || !name[0] || !status)
+        return -EINVAL;
+
+    page = media_status_get_page();
+    if (!page)
+        return -ENOENT;
+
+    for (i = 0; i < MEDIA_STATUS_CRITERIA; i++) {
+        criterion = &page->criteria[i];
+        do {
+            seq = atomic_load_explicit(&criterion->seq, memory_order_acquire);
+            memcpy(status, &criterion->data, sizeof(*status));
+            atomic_thread_fence(memory_order_acquire);
+        } while ((seq & 1) || seq != atomic_load_explicit(&criterion->seq, memory_order_relaxed));
+
+        if (!status->name[0])
+            break;
+
+        if (!strncmp(status->name, name, sizeof(status->name)))
+            return 0;
+    }
+
+    return -ENOENT;
+#else
+    return -ENOSYS;
+#endif
+}
+
 int media_policy_set_int(const char* name, int value, int apply)
 {
     char tmp[32];
 
+    media_policy_cache_invalidate(name);
     snprintf(tmp, sizeof(tmp), "%d", value);
     return media_proxy(MEDIA_ID_POLICY, NULL, name, "set_int", tmp, apply, NULL, 0);
 }
 
 int media_policy_get_int(const char* name, int* value)
 {
+    unsigned gen = 0;
     char tmp[32];
     int ret;
 
     if (!value)
         return -EINVAL;
 
+    if (media_policy_cache_get(name, MEDIA_POLICY_CACHE_INT, NULL,
+            value, 0, &gen) == 0)
+        return 0;
+
     ret = media_proxy(MEDIA_ID_POLICY, NULL, name, "get_int", NULL, 0, tmp, sizeof(tmp));
     if (ret >= 0) {
         *value = atoi(tmp);
+        media_policy_cache_put(name, MEDIA_POLICY_CACHE_INT, NULL, value, gen);
         ret = 0;
     }
 
@@ -272,15 +594,21 @@ int media_policy_get_range(const char* name, int* min_value, int* max_value)
 
 int media_policy_contain(const char* name, const char* values, int* result)
 {
+    unsigned gen = 0;
     char tmp[32];
     int ret;
 
     if (!result)
         return -EINVAL;
 
+    if (media_policy_cache_get(name, MEDIA_POLICY_CACHE_CONTAIN, values,
+            result, 0, &gen) == 0)
+        return 0;
+
     ret = media_proxy(MEDIA_ID_POLICY, NULL, name, "contain", values, 0, tmp, sizeof(tmp));
     if (ret >= 0) {
         *result = atoi(tmp);
+        media_policy_cache_put(name, MEDIA_POLICY_CACHE_CONTAIN, values, result, gen);
         ret = 0;
     }
 
@@ -289,31 +617,62 @@ int media_policy_contain(const char* name, const char* values, int* result)
 
 int media_policy_set_string(const char* name, const char* value, int apply)
 {
+    media_policy_cache_invalidate(name);
     return media_proxy(MEDIA_ID_POLICY, NULL, name, "set_string", value, apply, NULL, 0);
 }
 
+int media_policy_batch(const media_policy_change_t* changes, int nb, int apply)
+{
+    char* arg;
+    int ret;
+
+    arg = media_policy_batch_encode(changes, nb);
+    if (!arg)
+        return -EINVAL;
+
+    media_policy_cache_invalidate(NULL);
+    ret = media_proxy(MEDIA_ID_POLICY, NULL, NULL, "batch", arg, apply, NULL, 0);
+    free(arg);
+    return ret;
+}
+
 int media_policy_get_string(const char* name, char* value, int len)
 {
-    return media_proxy(MEDIA_ID_POLICY, NULL, name, "get_string", NULL, 0, value, len);
+    unsigned gen = 0;
+    int ret;
+
+    if (value && media_policy_cache_get(name, MEDIA_POLICY_CACHE_STRING,
+            NULL, value, len, &gen) == 0)
+        return 0;
+
+    ret = media_proxy(MEDIA_ID_POLICY, NULL, name, "get_string", NULL, 0, value, len);
+    if (ret >= 0 && value)
+        media_policy_cache_put(name, MEDIA_POLICY_CACHE_STRING, NULL, value, gen);
+
+    return ret;
 }
 
 int media_policy_include(const char* name, const char* values, int apply)
 {
+    media_policy_cache_invalidate(name);
     return media_proxy(MEDIA_ID_POLICY, NULL, name, "include", values, apply, NULL, 0);
 }
 
 int media_policy_exclude(const char* name, const char* values, int apply)
 {
+    media_policy_cache_invalidate(name);
     return media_proxy(MEDIA_ID_POLICY, NULL, name, "exclude", values, apply, NULL, 0);
 }
 
 int media_policy_increase(const char* name, int apply)
 {
+    media_policy_cache_invalidate(name);
     return media_proxy(MEDIA_ID_POLICY, NULL, name, "increase", NULL, apply, NULL, 0);
 }
 
 int media_policy_decrease(const char* name, int apply)
 {
+    media_policy_cache_invalidate(name);
     return media_proxy(MEDIA_ID_POLICY, NULL, name, "decrease", NULL, apply, NULL, 0);
 }
 
@@ -171,11 +171,40 @@ static void* media_proxy_listen_thread(void* pvarg)
     close(acceptfd);
 
 thread_error:
+    /* No more events, NULL tells the owner the connection is gone. */
+    priv->event_cb(priv->event_cookie, NULL);
     close(priv->listenfd);
     media_proxy_unref(priv);
     return NULL;
 }
 
+static int media_proxy_pack(MediaProxyPriv* priv, media_parcel* in,
+    const char* target, const char* cmd, const char* arg, int apply, int res_len)
+{
+    switch (priv->type) {
+    case MEDIA_ID_FOCUS:
+        return media_parcel_append_printf(in, "%i%s%s%i", priv->type,
+            target, cmd, res_len);
+
+    case MEDIA_ID_GRAPH:
+        return media_parcel_append_printf(in, "%i%s%s%s%i", priv->type,
+            target, cmd, arg, res_len);
+
+    case MEDIA_ID_POLICY:
+        return media_parcel_append_printf(in, "%i%s%s%s%i%i", priv->type,
+            target, cmd, arg, apply, res_len);
+
+    case MEDIA_ID_PLAYER:
+    case MEDIA_ID_RECORDER:
+    case MEDIA_ID_SESSION:
+        return media_parcel_append_printf(in, "%i%s%s%s%i", priv->type,
+            target, cmd, arg, res_len);
+
+    default:
+        return -EINVAL;
+    }
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -375,41 +404,7 @@ int media_proxy_once(void* handle, const char* target, const char* cmd,
     media_parcel_init(&in);
     media_parcel_init(&out);
 
-    switch (priv->type) {
-    case MEDIA_ID_FOCUS:
-        ret = media_parcel_append_printf(&in, "%i%s%s%i", priv->type,
-            target, cmd, res_len);
-        break;
-
-    case MEDIA_ID_GRAPH:
-        ret = media_parcel_append_printf(&in, "%i%s%s%s%i", priv->type,
-            target, cmd, arg, res_len);
-        break;
-
-    case MEDIA_ID_POLICY:
-        ret = media_parcel_append_printf(&in, "%i%s%s%s%i%i", priv->type,
-            target, cmd, arg, apply, res_len);
-        break;
-
-    case MEDIA_ID_PLAYER:
-        ret = media_parcel_append_printf(&in, "%i%s%s%s%i", priv->type,
-            target, cmd, arg, res_len);
-        break;
-
-    case MEDIA_ID_RECORDER:
-        ret = media_parcel_append_printf(&in, "%i%s%s%s%i", priv->type,
-            target, cmd, arg, res_len);
-        break;
-
-    case MEDIA_ID_SESSION:
-        ret = media_parcel_append_printf(&in, "%i%s%s%s%i", priv->type,
-            target, cmd, arg, res_len);
-        break;
-
-    default:
-        goto out;
-    }
-
+    ret = media_proxy_pack(priv, &in, target, cmd, arg, apply, res_len);
     if (ret < 0)
         goto out;
 
@@ -434,6 +429,30 @@ out:
     return ret < 0 ? ret : resp;
 }
 
+int media_proxy_post(void* handle, const char* target, const char* cmd,
+    const char* arg, int apply)
+{
+    MediaProxyPriv* priv = handle;
+    media_parcel in;
+    int ret = -EINVAL;
+
+    if (!priv || !priv->proxy)
+        return ret;
+
+    media_parcel_init(&in);
+
+    ret = media_proxy_pack(priv, &in, target, cmd, arg, apply, 0);
+    if (ret >= 0)
+        ret = media_proxy_send(priv->proxy, &in);
+
+    media_parcel_deinit(&in);
+
+    MEDIA_INFO("%s:%s:%p %s %s %s %s ret:%d (post)\n",
+        media_id_get_name(priv->type), priv->cpu, (void*)(uintptr_t)priv, target ? target : "_",
+        cmd, arg ? arg : "_", apply ? "apply" : "_", ret);
+    return ret;
+}
+
 int media_proxy(int id, void* handle, const char* target, const char* cmd,
     const char* arg, int apply, char* res, int res_len)
 {
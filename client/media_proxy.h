@@ -61,6 +61,8 @@ int media_proxy_send(void* handle, media_parcel* in);
 int media_proxy_send_with_ack(void* handle, media_parcel* in, media_parcel* out);
 int media_proxy_send_recieve(void* handle, const char* in_fmt, const char* out_fmt, ...);
 
+/* `event_cb` runs in the listener thread, a NULL parcel is its last call:
+ * the event connection is closed by server or lost. */
 int media_proxy_set_event_cb(void* handle, const char* cpu,
     void* event_cb, void* cookie);
 int media_proxy_set_release_cb(void* handle, void* release_cb, void* cookie);
@@ -81,6 +83,23 @@ int media_proxy_set_release_cb(void* handle, void* release_cb, void* cookie);
 int media_proxy_once(void* handle, const char* target, const char* cmd,
     const char* arg, int apply, char* res, int res_len);
 
+/**
+ * @brief Post a command to server through existed long connection,
+ * without waiting for its result.
+ *
+ * @param handle    Instance handle.
+ * @param target
+ * @param cmd
+ * @param arg
+ * @param apply     Same as `media_proxy_once`.
+ * @return int      Zero on success; a negated errno value on failure.
+ *
+ * @note Server processes commands of one connection in order, so a
+ * later `media_proxy_once` still observes the effect of posted ones.
+ */
+int media_proxy_post(void* handle, const char* target, const char* cmd,
+    const char* arg, int apply);
+
 /**
  * @brief Transact a command to server.
  *
@@ -63,12 +63,16 @@ static void media_event_cb(void* cookie, media_parcel* msg)
     int32_t event;
     int32_t ret;
 
+    if (!msg)
+        return;
+
     media_parcel_read_scanf(msg, "%i%i%s", &event, &ret, &extra);
+    /* Events carry the metadata, query again only if it's missing. */
     if (event == MEDIA_EVENT_CHANGED) {
         media_metadata_reinit(&priv->data);
-        priv->need_query = true;
-    } else if (event == MEDIA_EVENT_UPDATED)
-        priv->need_query = true;
+        priv->need_query = media_metadata_apply(&priv->data, extra) < 0;
+    } else if (event == MEDIA_EVENT_UPDATED && !priv->need_query)
+        priv->need_query = media_metadata_apply(&priv->data, extra) < 0;
 
     if (priv->event)
         priv->event(priv->cookie, event, ret, extra);
@@ -164,19 +168,36 @@ int media_session_stop(void* handle)
 int media_session_query(void* handle, const media_metadata_t** data)
 {
     MediaSessionPriv* priv = handle;
-    char tmp[256];
+    int len = MEDIA_METADATA_QUERY_SIZE;
+    char* tmp;
     int ret;
 
     if (!priv)
         return -EINVAL;
 
     if (priv->need_query) {
-        ret = media_proxy_once(handle, NULL, "query", NULL, 0, tmp, sizeof(tmp));
-        if (ret < 0)
+        /* Strings have no length limit, grow reply until it fits. */
+        for (; ; ) {
+            tmp = malloc(len);
+            if (!tmp)
+                return -ENOMEM;
+
+            ret = media_proxy_once(handle, NULL, "query", NULL, 0, tmp, len);
+            if (ret != -E2BIG || len >= MEDIA_METADATA_QUERY_MAX)
+                break;
+
+            free(tmp);
+            len *= 2;
+        }
+
+        if (ret < 0) {
+            free(tmp);
             return ret;
+        }
 
         media_metadata_reinit(&priv->data);
         ret = media_metadata_unserialize(&priv->data, tmp);
+        free(tmp);
         if (ret < 0) {
             media_metadata_deinit(&priv->data);
             return ret;
@@ -333,7 +354,8 @@ int media_session_notify(void* handle, int event, int result, const char* extra)
 
 int media_session_update(void* handle, const media_metadata_t* data)
 {
-    char tmp[256];
+    char* tmp;
+    int len, ret;
 
     if (!handle || !data)
         return -EINVAL;
@@ -343,8 +365,15 @@ int media_session_update(void* handle, const media_metadata_t* data)
      * should remove `server/media_stub.c`, let each `server/.c` unmarshal control message;
      * then here we can append needed parameters to parcel, which makes parcel smaller.
      */
-    media_metadata_serialize(data, tmp, sizeof(tmp));
-    return media_proxy_once(handle, NULL, "update", tmp, 0, NULL, 0);
+    len = media_metadata_serialize(data, NULL, 0) + 1;
+    tmp = malloc(len);
+    if (!tmp)
+        return -ENOMEM;
+
+    media_metadata_serialize(data, tmp, len);
+    ret = media_proxy_once(handle, NULL, "update", tmp, 0, NULL, 0);
+    free(tmp);
+    return ret;
 }
 
 int media_session_unregister(void* handle)
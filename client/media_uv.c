@@ -108,6 +108,7 @@ struct MediaProxyPriv {
     int nb_sent;
     int nb_recv;
     int flags;
+    bool unref; /* Command uv_pipe should not keep loop alive. */
 };
 
 /****************************************************************************
@@ -123,6 +124,7 @@ static void media_uv_free_proxy(MediaProxyPriv* proxy);
 
 /* clear queue and call cb. */
 static void media_uv_clear_queue(MediaProxyPriv* proxy);
+static void media_uv_cancel_queue(MediaProxyPriv* proxy);
 
 /* Shutdown and close. */
 static void media_uv_close_cb(uv_handle_t* handle);
@@ -211,6 +213,9 @@ static MediaPipePriv* media_uv_alloc_pipe(MediaProxyPriv* proxy)
     pipe->proxy = proxy;
     media_parcel_init(&pipe->parcel);
     uv_handle_set_data((uv_handle_t*)&pipe->handle, pipe);
+    if (proxy->unref)
+        uv_unref((uv_handle_t*)&pipe->handle);
+
     return pipe;
 }
 
@@ -226,6 +231,36 @@ static void media_uv_clear_queue(MediaProxyPriv* proxy)
     }
 }
 
+/**
+ * @brief Fail all writings waiting for response.
+ *
+ * Command uv_pipe is closed while user still holds the proxy, on_receive
+ * is called with NULL parcel as uv_write failure does. User might
+ * disconnect (and so free) proxy in on_receive, so don't touch it after.
+ */
+static void media_uv_cancel_queue(MediaProxyPriv* proxy)
+{
+    void* cookie = proxy->cookie;
+    MediaWriteQueue queue;
+    MediaWritePriv* writing;
+
+    TAILQ_INIT(&queue);
+    TAILQ_CONCAT(&queue, &proxy->sentq, entry);
+    TAILQ_CONCAT(&queue, &proxy->pendq, entry);
+    proxy->nb_sentq = 0;
+    proxy->nb_pendq = 0;
+
+    while ((writing = TAILQ_FIRST(&queue))) {
+        TAILQ_REMOVE(&queue, writing, entry);
+        if (writing->parcel.chunk->code == MEDIA_PARCEL_SEND_ACK)
+            writing->on_receive(cookie,
+                writing->cookies[0], writing->cookies[1], NULL);
+
+        writing->flags = MEDIA_MSGFLAG_WRITTEN | MEDIA_MSGFLAG_RESPONSED;
+        media_uv_free_writing(writing);
+    }
+}
+
 /**
  * @brief free proxy.
  *
@@ -256,9 +291,14 @@ static void media_uv_close_cb(uv_handle_t* handle)
     MediaProxyPriv* proxy = pipe->proxy;
 
     MEDIA_DEBUG_PROXY(proxy);
-    if (pipe == proxy->cpipe)
+    if (pipe == proxy->cpipe) {
         proxy->cpipe = NULL;
-    else if (pipe == proxy->epipe)
+        if (!(proxy->flags & MEDIA_PROXYFLAG_DISCONNECT)) {
+            media_uv_free_pipe(pipe);
+            media_uv_cancel_queue(proxy);
+            return;
+        }
+    } else if (pipe == proxy->epipe)
         proxy->epipe = NULL;
 
     media_uv_free_pipe(pipe);
@@ -313,7 +353,12 @@ static void media_uv_reconnect_one(MediaProxyPriv* proxy)
     /* Try connect to next cpu. */
     proxy->cpu = strtok_r(NULL, MEDIA_CPU_DELIM, &proxy->cpus);
     if (!proxy->cpu) {
-        media_uv_clear_queue(proxy);
+        /* Pending writings fail in media_uv_close_cb, as server lost. */
+        if (proxy->cpipe)
+            media_uv_close(proxy->cpipe);
+        else
+            media_uv_clear_queue(proxy);
+
         proxy->on_connect(proxy->cookie, -ENOENT);
         return;
     }
@@ -770,7 +815,8 @@ int media_uv_disconnect(void* handle, media_uv_callback on_release)
 
     proxy->on_release = on_release;
 
-    if (proxy->flags == 0) /* Needn't shutdown command socket if not ready. */
+    /* Needn't shutdown command socket if not ready or already closed. */
+    if (proxy->flags == 0 && proxy->cpipe)
         media_uv_shutdown(proxy->cpipe);
 
     proxy->flags |= MEDIA_PROXYFLAG_DISCONNECT;
@@ -794,6 +840,25 @@ int media_uv_reconnect(void* handle)
     return 0;
 }
 
+int media_uv_ref(void* handle, bool ref)
+{
+    MediaProxyPriv* proxy = handle;
+
+    if (!proxy)
+        return -EINVAL;
+
+    proxy->unref = !ref;
+    if (!proxy->cpipe)
+        return 0;
+
+    if (ref)
+        uv_ref((uv_handle_t*)&proxy->cpipe->handle);
+    else
+        uv_unref((uv_handle_t*)&proxy->cpipe->handle);
+
+    return 0;
+}
+
 int media_uv_listen(void* handle, media_uv_callback on_listen,
     media_uv_parcel_callback on_event)
 {
@@ -844,6 +909,11 @@ int media_uv_send(void* handle, media_uv_parcel_callback on_receive,
         goto err;
     }
 
+    if (!proxy->cpipe) {
+        ret = -EPIPE; /* Closed by server, user should reconnect. */
+        goto err;
+    }
+
     if (!on_receive || !cookie0)
         writing = media_uv_alloc_writing(MEDIA_PARCEL_SEND, parcel);
     else
@@ -26,6 +26,7 @@
  ****************************************************************************/
 
 #include <media_defs.h>
+#include <stdbool.h>
 
 #include "media_parcel.h"
 
@@ -114,6 +115,18 @@ int media_uv_disconnect(void* handle, media_uv_callback on_release);
  */
 int media_uv_reconnect(void* handle);
 
+/**
+ * @brief Whether command connection keeps uv loop alive.
+ *
+ * Long-term connection shared by requests should not prevent loop from
+ * exiting while there is no request waiting for response.
+ *
+ * @param handle    Handle.
+ * @param ref       True to keep loop alive (default), false not.
+ * @return int      Zero on success, negative errno on failure.
+ */
+int media_uv_ref(void* handle, bool ref);
+
 /**
  * @brief Create listener connection.
  *
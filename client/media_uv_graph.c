@@ -25,11 +25,11 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <media_defs.h>
-#include <media_focus.h>
 #include <media_player.h>
 #include <media_policy.h>
 #include <media_recorder.h>
 #include <media_utils.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <sys/queue.h>
 #include <uv.h>
@@ -58,18 +58,11 @@ typedef LIST_HEAD(MediaListenList, MediaListenPriv) MediaListenList;
     uv_pipe_t* pipe;                              \
     MediaListenList listeners;                    \
     media_uv_object_callback on_connection;       \
-    /* Fields for auto focus. */                  \
-    MediaFocusPriv* focus;                        \
+    /* Focus held by mediad for start_auto. */    \
+    bool focus;                                   \
     /* Fields for query metadata. */              \
     MediaQueryPriv* query;
 
-typedef struct MediaFocusPriv {
-    void* stream;
-    void* handle; /* Focus handle. */
-    media_uv_callback on_play;
-    void* on_play_cookie;
-} MediaFocusPriv;
-
 typedef struct MediaQueryPriv {
     void* player;
     int expected;
@@ -144,22 +137,16 @@ static int media_uv_stream_listen_init(MediaStreamPriv* priv, const char* addr);
 
 /* Functions for focus suggestions. */
 
-static void media_uv_stream_abandon_focus_cb(void* cookie, int ret);
 static void media_uv_stream_abandon_focus(MediaStreamPriv* stream);
-static int media_uv_stream_request_focus(MediaStreamPriv* stream,
-    const char* scenario, media_focus_callback on_suggestion,
-    media_uv_callback on_play, void* cookie);
-static void media_uv_player_suggest_cb(int suggest, void* cookie);
-static void media_uv_recorder_suggest_cb(int suggest, void* cookie);
+static void media_uv_stream_receive_focus_cb(void* cookie,
+    void* cookie0, void* cookie1, media_parcel* parcel);
+static int media_uv_stream_start_auto(MediaStreamPriv* priv,
+    const char* scenario, media_uv_callback cb, void* cookie);
 static int media_uv_stream_pause(MediaStreamPriv* priv, void* cb, void* cookie);
 
 /* Functions to query metadata. */
 
-static void media_uv_player_query_complete(void* cookie);
-static void media_uv_player_query_duration_cb(void* cookie, int ret, unsigned value);
-static void media_uv_player_query_position_cb(void* cookie, int ret, unsigned value);
-static void media_uv_player_query_state_cb(void* cookie, int ret, int value);
-static void media_uv_player_query_volume_cb(void* cookie, int ret, int value);
+static void media_uv_player_query_cb(void* cookie, int ret, const char* value);
 
 /****************************************************************************
  * Common Functions
@@ -510,52 +497,42 @@ err:
     return ret;
 }
 
-static void media_uv_stream_abandon_focus_cb(void* cookie, int ret)
+static void media_uv_stream_abandon_focus(MediaStreamPriv* stream)
 {
-    free(cookie);
+    /* mediad abandons the focus itself on pause/stop/close/completed. */
+    if (stream)
+        stream->focus = false;
 }
 
-static void media_uv_stream_abandon_focus(MediaStreamPriv* stream)
+static void media_uv_stream_receive_focus_cb(void* cookie,
+    void* cookie0, void* cookie1, media_parcel* parcel)
 {
-    MediaFocusPriv* priv;
-    int ret;
+    MediaStreamPriv* priv = cookie;
+    media_uv_callback cb = cookie0;
+    int32_t result = -ECANCELED;
 
-    if (!stream)
-        return;
+    if (parcel)
+        media_parcel_read_scanf(parcel, "%i%s", &result, NULL);
 
-    priv = stream->focus;
-    if (priv) {
-        ret = media_uv_focus_abandon(priv->handle, media_uv_stream_abandon_focus_cb);
-        if (ret >= 0) {
-            /* Detach focus and stream at once. */
-            priv->stream = NULL;
-            stream->focus = NULL;
-        }
-    }
+    if (result < 0) /* Focus request failed or suggested not to play. */
+        priv->focus = false;
+
+    if (cb)
+        cb(cookie1, result);
 }
 
-static int media_uv_stream_request_focus(MediaStreamPriv* stream,
-    const char* scenario, media_focus_callback on_suggestion,
-    media_uv_callback on_play, void* cookie)
+static int media_uv_stream_start_auto(MediaStreamPriv* priv,
+    const char* scenario, media_uv_callback cb, void* cookie)
 {
-    MediaFocusPriv* priv;
-
-    priv = zalloc(sizeof(MediaFocusPriv));
-    if (!priv)
-        return -ENOMEM;
+    int ret;
 
-    priv->stream = stream;
-    priv->on_play = on_play;
-    priv->on_play_cookie = cookie;
-    priv->handle = media_uv_focus_request(stream->loop, scenario,
-        on_suggestion, priv);
-    if (!priv->handle) {
-        free(priv);
-        return -ENOMEM;
-    }
+    /* Focus request and suggestion are applied by mediad in one command. */
+    ret = media_uv_stream_send(priv, NULL, "start_auto", scenario, 0,
+        media_uv_stream_receive_focus_cb, cb, cookie);
+    if (ret >= 0)
+        priv->focus = true;
 
-    stream->focus = priv;
-    return 0;
+    return ret;
 }
 
 static int media_uv_stream_pause(MediaStreamPriv* priv, void* cb, void* cookie)
@@ -568,131 +545,24 @@ static int media_uv_stream_pause(MediaStreamPriv* priv, void* cb, void* cookie)
  * Player Functions
  ****************************************************************************/
 
-static void media_uv_player_query_complete(void* cookie)
+static void media_uv_player_query_cb(void* cookie, int ret, const char* value)
 {
     MediaQueryPriv* ctx = cookie;
     MediaPlayerPriv* priv = ctx->player;
-    int flags = 0;
-
-    if (!ctx->expected) {
-        flags = ctx->diff.flags;
-        media_metadata_update(&priv->data, &ctx->diff);
-        ctx->on_query(ctx->cookie, flags, &priv->data);
-    }
-
-    media_uv_stream_release((MediaStreamPriv*)priv);
-}
-
-static void media_uv_player_query_state_cb(void* cookie, int ret, int value)
-{
-    MediaQueryPriv* ctx = cookie;
-
-    ctx->expected &= ~MEDIA_METAFLAG_STATE;
-
-    if (ret >= 0) {
-        ctx->diff.state = value;
-        ctx->diff.flags |= MEDIA_METAFLAG_STATE;
-    }
-
-    media_uv_player_query_complete(ctx);
-}
-
-static void media_uv_player_query_volume_cb(void* cookie, int ret, int value)
-{
-    MediaQueryPriv* ctx = cookie;
-
-    ctx->expected &= ~MEDIA_METAFLAG_VOLUME;
-
-    if (ret >= 0) {
-        ctx->diff.volume = value;
-        ctx->diff.flags |= MEDIA_METAFLAG_VOLUME;
-    }
-
-    media_uv_player_query_complete(ctx);
-}
-
-static void media_uv_player_query_position_cb(void* cookie, int ret, unsigned value)
-{
-    MediaQueryPriv* ctx = cookie;
-
-    ctx->expected &= ~MEDIA_METAFLAG_POSITION;
-
-    if (ret >= 0) {
-        ctx->diff.position = value;
-        ctx->diff.flags |= MEDIA_METAFLAG_POSITION;
-    }
-
-    media_uv_player_query_complete(ctx);
-}
-
-static void media_uv_player_query_duration_cb(void* cookie, int ret, unsigned value)
-{
-    MediaQueryPriv* ctx = cookie;
+    media_metadata_t* diff = &ctx->diff;
 
-    ctx->expected &= ~MEDIA_METAFLAG_DURATION;
+    ctx->expected = 0;
 
-    if (ret >= 0) {
-        ctx->diff.duration = value;
-        ctx->diff.flags |= MEDIA_METAFLAG_DURATION;
-    }
-
-    media_uv_player_query_complete(ctx);
-}
-
-static void media_uv_player_suggest_cb(int suggest, void* cookie)
-{
-    MediaFocusPriv* priv = cookie;
-    MediaPlayerPriv* player = priv->stream;
-    bool suggest_active = false;
-
-    if (!player) {
-        MEDIA_INFO("suggest:%d canceled\n", suggest);
-        goto out;
-    }
+    if (ret >= 0 && value
+        && sscanf(value, "%d:%d:%d:%u:%u:%u", &diff->flags, &diff->state,
+               &diff->volume, &diff->position, &diff->duration, &diff->latency)
+            == 6)
+        media_metadata_update(&priv->data, diff);
+    else
+        diff->flags = 0;
 
-    MEDIA_INFO("%s:%p suggest:%d\n", player->name, player, suggest);
-
-    switch (suggest) {
-    case MEDIA_FOCUS_PLAY:
-        suggest_active = true;
-        media_uv_player_set_volume(player, 1.0, NULL, NULL);
-        media_uv_player_start(player, priv->on_play, priv->on_play_cookie);
-        break;
-
-    case MEDIA_FOCUS_STOP:
-        suggest_active = false;
-        media_uv_player_stop(player, NULL, NULL);
-        break;
-
-    case MEDIA_FOCUS_PAUSE:
-        suggest_active = false;
-        media_uv_stream_pause(priv->stream, NULL, NULL);
-        break;
-
-    case MEDIA_FOCUS_PLAY_BUT_SILENT:
-        suggest_active = true;
-        media_uv_player_set_volume(player, 0.0, NULL, NULL);
-        media_uv_player_start(player, NULL, NULL);
-        break;
-
-    case MEDIA_FOCUS_PLAY_WITH_DUCK:
-        suggest_active = true;
-        media_uv_player_set_volume(player, 0.1, NULL, NULL);
-        media_uv_player_start(player, NULL, NULL);
-        break;
-
-    case MEDIA_FOCUS_PLAY_WITH_KEEP:
-        break;
-    }
-
-out:
-    if (priv->on_play) {
-        if (!suggest_active) /* Notify user if focus request failed. */
-            priv->on_play(priv->on_play_cookie, -EPERM);
-
-        priv->on_play = NULL;
-        priv->on_play_cookie = NULL;
-    }
+    ctx->on_query(ctx->cookie, diff->flags, &priv->data);
+    media_uv_stream_release((MediaStreamPriv*)priv);
 }
 
 void* media_uv_player_open(void* loop, const char* stream,
@@ -804,6 +674,24 @@ int media_uv_player_prepare(void* handle, const char* url, const char* options,
     return ret;
 }
 
+int media_uv_player_queue_next(void* handle, const char* url, const char* options,
+    media_uv_callback on_queue, void* cookie)
+{
+    int ret = 0;
+
+    if (!handle)
+        return -EINVAL;
+
+    if (options && options[0] != '\0')
+        ret = media_uv_stream_send(handle, NULL, "set_next_options", options, 0, NULL, NULL, NULL);
+
+    if (ret >= 0)
+        ret = media_uv_stream_send(handle, NULL, "queue_next", url, 0,
+            media_uv_stream_receive_cb, on_queue, cookie);
+
+    return ret;
+}
+
 int media_uv_player_reset(void* handle, media_uv_callback cb, void* cookie)
 {
     if (!handle)
@@ -829,8 +717,7 @@ int media_uv_player_start_auto(void* handle, const char* scenario,
         return media_uv_player_start(priv, cb, cookie);
     }
 
-    return media_uv_stream_request_focus(handle, scenario,
-        media_uv_player_suggest_cb, cb, cookie);
+    return media_uv_stream_start_auto(handle, scenario, cb, cookie);
 }
 
 int media_uv_player_start(void* handle, media_uv_callback cb, void* cookie)
@@ -942,6 +829,19 @@ int media_uv_player_set_looping(void* handle, int loop,
         media_uv_stream_receive_cb, cb, cookie);
 }
 
+int media_uv_player_set_progress_interval(void* handle, unsigned int interval,
+    media_uv_callback cb, void* cookie)
+{
+    char tmp[32];
+
+    if (!handle)
+        return -EINVAL;
+
+    snprintf(tmp, sizeof(tmp), "%u", interval);
+    return media_uv_stream_send(handle, NULL, "set_progress", tmp, 0,
+        media_uv_stream_receive_cb, cb, cookie);
+}
+
 int media_uv_player_seek(void* handle, unsigned int msec,
     media_uv_callback cb, void* cookie)
 {
@@ -978,6 +878,7 @@ int media_uv_player_get_property(void* handle, const char* target, const char* k
 int media_uv_player_query(void* handle, media_uv_object_callback cb, void* cookie)
 {
     MediaPlayerPriv* priv = handle;
+    int ret;
 
     if (!priv || !cb)
         return -EINVAL;
@@ -993,75 +894,21 @@ int media_uv_player_query(void* handle, media_uv_object_callback cb, void* cooki
     priv->query->player = priv;
     priv->query->cookie = cookie;
 
-    if (media_uv_player_get_playing(handle, media_uv_player_query_state_cb, priv->query) >= 0)
-        priv->query->expected |= MEDIA_METAFLAG_STATE;
-
-    if (media_uv_policy_get_stream_volume(priv->loop, priv->name,
-            media_uv_player_query_volume_cb, priv->query)
-        >= 0)
-        priv->query->expected |= MEDIA_METAFLAG_VOLUME;
-
-    if (media_uv_player_get_duration(handle, media_uv_player_query_duration_cb, priv->query) >= 0)
-        priv->query->expected |= MEDIA_METAFLAG_DURATION;
-
-    if (media_uv_player_get_position(handle, media_uv_player_query_position_cb, priv->query) >= 0)
-        priv->query->expected |= MEDIA_METAFLAG_POSITION;
-
-    if (!priv->query->expected) {
-        return -EINVAL;
-    }
+    /* State, volume, position, duration and latency in one request. */
+    ret = media_uv_stream_send(handle, NULL, "query", NULL, 64,
+        media_uv_stream_receive_string_cb, media_uv_player_query_cb, priv->query);
+    if (ret < 0)
+        return ret;
 
+    priv->query->expected = MEDIA_METAFLAG_STATE | MEDIA_METAFLAG_VOLUME
+        | MEDIA_METAFLAG_POSITION | MEDIA_METAFLAG_DURATION
+        | MEDIA_METAFLAG_LATENCY;
     return 0;
 }
 /****************************************************************************
  * Recorder Functions
  ****************************************************************************/
 
-static void media_uv_recorder_suggest_cb(int suggest, void* cookie)
-{
-    MediaFocusPriv* priv = cookie;
-    MediaRecorderPriv* recorder = priv->stream;
-    bool suggest_active = false;
-
-    if (!recorder) {
-        MEDIA_INFO("suggest:%d canceled\n", suggest);
-        goto out;
-    }
-
-    MEDIA_INFO("%s:%p suggest:%d\n", recorder->name, recorder, suggest);
-
-    switch (suggest) {
-    case MEDIA_FOCUS_PLAY:
-    case MEDIA_FOCUS_PLAY_BUT_SILENT:
-    case MEDIA_FOCUS_PLAY_WITH_DUCK:
-        suggest_active = true;
-        media_uv_recorder_start(recorder, priv->on_play, priv->on_play_cookie);
-        break;
-
-    case MEDIA_FOCUS_STOP:
-        suggest_active = false;
-        media_uv_recorder_stop(recorder, NULL, NULL);
-        break;
-
-    case MEDIA_FOCUS_PAUSE:
-        suggest_active = false;
-        media_uv_stream_pause(priv->stream, NULL, NULL);
-        break;
-
-    case MEDIA_FOCUS_PLAY_WITH_KEEP:
-        break;
-    }
-
-out:
-    if (priv->on_play) {
-        if (!suggest_active) /* Notify user if focus request failed. */
-            priv->on_play(priv->on_play_cookie, -EPERM);
-
-        priv->on_play = NULL;
-        priv->on_play_cookie = NULL;
-    }
-}
-
 void* media_uv_recorder_open(void* loop, const char* source,
     media_uv_callback on_open, void* cookie)
 {
@@ -1182,8 +1029,7 @@ int media_uv_recorder_start_auto(void* handle, const char* scenario,
         return media_uv_recorder_start(priv, cb, cookie);
     }
 
-    return media_uv_stream_request_focus(handle, scenario,
-        media_uv_recorder_suggest_cb, cb, cookie);
+    return media_uv_stream_start_auto(handle, scenario, cb, cookie);
 }
 
 int media_uv_recorder_start(void* handle, media_uv_callback cb, void* cookie)
@@ -24,7 +24,10 @@
 
 #include <errno.h>
 #include <media_policy.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/queue.h>
 
 #include "media_common.h"
 #include "media_uv.h"
@@ -33,370 +36,399 @@
  * Private Types
  ****************************************************************************/
 
-typedef struct MediaPolicyPriv {
+/* Long-term connection shared by all policy requests of one loop. */
+
+typedef struct MediaPolicyConn {
+    TAILQ_ENTRY(MediaPolicyConn) entry;
+    void* loop;
     void* proxy;
-    media_parcel parcel;
-    media_uv_parcel_callback parser;
-    void* cb;
-    void* cookie;
-} MediaPolicyPriv;
+    int pending; /* Requests waiting for response. */
+    bool broken; /* Removed from list, disconnect once pending is done. */
+} MediaPolicyConn;
+
+typedef TAILQ_HEAD(MediaPolicyConnList, MediaPolicyConn) MediaPolicyConnList;
 
 /****************************************************************************
  * Private Functions Prototypes
  ****************************************************************************/
 
-static void media_uv_policy_free(MediaPolicyPriv* priv);
-static MediaPolicyPriv*
-media_uv_policy_alloc(const char* name, const char* cmd, const char* value,
-    int apply, int len, media_uv_parcel_callback parser, void* cb, void* cookie);
+static MediaPolicyConn* media_uv_policy_get_conn(void* loop);
+static void media_uv_policy_put_conn(MediaPolicyConn* conn);
+static void media_uv_policy_drop_conn(MediaPolicyConn* conn);
+static int media_uv_policy_send(MediaPolicyConn* conn, const char* name,
+    const char* cmd, const char* value, int apply, int len,
+    media_uv_parcel_callback parser, void* cb, void* cookie);
+static int media_uv_policy_request(void* loop, const char* name,
+    const char* cmd, const char* value, int apply, int len,
+    media_uv_parcel_callback parser, void* cb, void* cookie);
 
 static void media_uv_policy_release_cb(void* cookie, int ret);
 static void media_uv_policy_connect_cb(void* cookie, int ret);
 
-static void media_uv_policy_receive_cb(void* cookie,
+static void media_uv_policy_receive_ping_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel);
 static void media_uv_policy_receive_default_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel);
+static void media_uv_policy_receive_cb(void* cookie,
+    void* cookie0, void* cookie1, media_parcel* parcel);
 static void media_uv_policy_receive_int_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel);
 static void media_uv_policy_receive_string_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel);
 
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static MediaPolicyConnList g_media_uv_policy_conns
+    = TAILQ_HEAD_INITIALIZER(g_media_uv_policy_conns);
+static pthread_mutex_t g_media_uv_policy_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
-static void media_uv_policy_free(MediaPolicyPriv* priv)
+/* Find the connection of current loop, or connect a new one. */
+static MediaPolicyConn* media_uv_policy_get_conn(void* loop)
 {
-    if (priv) {
-        media_parcel_deinit(&priv->parcel);
-        free(priv);
+    MediaPolicyConn* conn;
+
+    pthread_mutex_lock(&g_media_uv_policy_mutex);
+    TAILQ_FOREACH(conn, &g_media_uv_policy_conns, entry)
+    {
+        if (conn->loop == loop)
+            goto out;
     }
+
+    conn = zalloc(sizeof(MediaPolicyConn));
+    if (!conn)
+        goto out;
+
+    conn->loop = loop;
+    conn->proxy = media_uv_connect(loop, media_get_cpuname(),
+        media_uv_policy_connect_cb, conn);
+    if (!conn->proxy) {
+        free(conn);
+        conn = NULL;
+        goto out;
+    }
+
+    media_uv_ref(conn->proxy, false);
+    TAILQ_INSERT_TAIL(&g_media_uv_policy_conns, conn, entry);
+    MEDIA_DEBUG("loop:%p handle:%p\n", loop, conn->proxy);
+
+out:
+    pthread_mutex_unlock(&g_media_uv_policy_mutex);
+    return conn;
 }
 
-static MediaPolicyPriv*
-media_uv_policy_alloc(const char* name, const char* cmd, const char* value,
-    int apply, int len, media_uv_parcel_callback parser, void* cb, void* cookie)
+/* One request is done, let loop exit if nothing else to wait. */
+static void media_uv_policy_put_conn(MediaPolicyConn* conn)
 {
-    MediaPolicyPriv* priv;
+    if (--conn->pending > 0)
+        return;
 
-    priv = zalloc(sizeof(MediaPolicyPriv));
-    if (!priv)
-        return NULL;
+    if (conn->broken)
+        media_uv_disconnect(conn->proxy, media_uv_policy_release_cb);
+    else
+        media_uv_ref(conn->proxy, false);
+}
 
-    media_parcel_init(&priv->parcel);
-    if (media_parcel_append_printf(&priv->parcel, "%i%s%s%s%i%i",
-            MEDIA_ID_POLICY, name, cmd, value, apply, len)
-        < 0) {
-        media_uv_policy_free(priv);
-        return NULL;
-    }
+/* Stop sharing a failed connection, next request would connect again. */
+static void media_uv_policy_drop_conn(MediaPolicyConn* conn)
+{
+    if (conn->broken)
+        return;
+
+    pthread_mutex_lock(&g_media_uv_policy_mutex);
+    TAILQ_REMOVE(&g_media_uv_policy_conns, conn, entry);
+    pthread_mutex_unlock(&g_media_uv_policy_mutex);
+
+    conn->broken = true;
+    if (conn->pending == 0)
+        media_uv_disconnect(conn->proxy, media_uv_policy_release_cb);
+}
+
+static int media_uv_policy_send(MediaPolicyConn* conn, const char* name,
+    const char* cmd, const char* value, int apply, int len,
+    media_uv_parcel_callback parser, void* cb, void* cookie)
+{
+    media_parcel parcel;
+    int ret;
+
+    /* Always ask for response, so loop is kept alive until it's done. */
 
     if (!cb) {
-        priv->parser = media_uv_policy_receive_default_cb;
-        priv->cookie = cookie;
-        priv->cb = priv; /* XXX: need a common solution on dev.*/
-        return priv;
+        parser = media_uv_policy_receive_default_cb;
+        cb = conn;
+    }
+
+    media_parcel_init(&parcel);
+    ret = media_parcel_append_printf(&parcel, "%i%s%s%s%i%i",
+        MEDIA_ID_POLICY, name, cmd, value, apply, len);
+    if (ret >= 0)
+        ret = media_uv_send(conn->proxy, parser, cb, cookie, &parcel);
+
+    media_parcel_deinit(&parcel);
+    if (ret < 0)
+        return ret;
+
+    if (conn->pending++ == 0)
+        media_uv_ref(conn->proxy, true);
+
+    return 0;
+}
+
+static int media_uv_policy_request(void* loop, const char* name,
+    const char* cmd, const char* value, int apply, int len,
+    media_uv_parcel_callback parser, void* cb, void* cookie)
+{
+    MediaPolicyConn* conn;
+    int ret = -ENOMEM;
+    int retry;
+
+    for (retry = 0; retry < 2; retry++) {
+        conn = media_uv_policy_get_conn(loop);
+        if (!conn)
+            break;
+
+        ret = media_uv_policy_send(conn, name, cmd, value, apply, len,
+            parser, cb, cookie);
+        if (ret != -EPIPE)
+            break;
+
+        /* Closed by server since last request, connect again. */
+        media_uv_policy_drop_conn(conn);
     }
 
-    priv->parser = parser;
-    priv->cookie = cookie;
-    priv->cb = cb;
-    return priv;
+    MEDIA_DEBUG("loop:%p %s %s %s ret:%d.", loop,
+        name ? name : "_", cmd, value ? value : "_", ret);
+
+    return ret;
 }
 
 static void media_uv_policy_release_cb(void* cookie, int ret)
 {
-    MediaPolicyPriv* priv = cookie;
-
-    media_uv_policy_free(priv);
+    free(cookie);
 }
 
 static void media_uv_policy_connect_cb(void* cookie, int ret)
 {
-    MediaPolicyPriv* priv = cookie;
+    MediaPolicyConn* conn = cookie;
+
+    /* No server left, queued requests are then failed by media_uv with
+     * NULL parcel, the last one disconnects the dropped conn. */
+
+    if (ret == -ENOENT) {
+        media_uv_policy_drop_conn(conn);
+        return;
+    }
 
-    if (ret == -ENOENT)
-        media_uv_disconnect(priv->proxy, media_uv_policy_release_cb);
+    /* First message to recognize the server, then the pended requests
+     * are sent. */
 
     if (ret >= 0)
-        ret = media_uv_send(priv->proxy, priv->parser, priv->cb, priv->cookie, &priv->parcel);
+        ret = media_uv_policy_send(conn, NULL, "ping", NULL, 0, 0,
+            media_uv_policy_receive_ping_cb, conn, NULL);
 
     if (ret < 0)
-        media_uv_reconnect(priv->proxy);
+        media_uv_reconnect(conn->proxy);
+}
+
+static void media_uv_policy_receive_ping_cb(void* cookie,
+    void* cookie0, void* cookie1, media_parcel* parcel)
+{
+    MediaPolicyConn* conn = cookie;
+    int32_t result = -ECANCELED;
+
+    if (parcel)
+        media_parcel_read_scanf(parcel, "%i%s", &result, NULL);
+
+    if (!parcel)
+        media_uv_policy_drop_conn(conn);
+    else if (result < 0)
+        media_uv_reconnect(conn->proxy); /* Try next server. */
+
+    media_uv_policy_put_conn(conn);
 }
 
 static void media_uv_policy_receive_default_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel)
 {
-    MediaPolicyPriv* priv = cookie;
+    MediaPolicyConn* conn = cookie;
 
-    media_uv_disconnect(priv->proxy, media_uv_policy_release_cb);
+    if (!parcel)
+        media_uv_policy_drop_conn(conn);
+
+    media_uv_policy_put_conn(conn);
 }
 
 static void media_uv_policy_receive_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel)
 {
-    MediaPolicyPriv* priv = cookie;
+    MediaPolicyConn* conn = cookie;
     media_uv_callback cb = cookie0;
     int32_t result = -ECANCELED;
 
-    if (cb) {
-        if (parcel)
-            media_parcel_read_scanf(parcel, "%i%s", &result, NULL);
-
-        cb(cookie1, result);
-    }
+    if (parcel)
+        media_parcel_read_scanf(parcel, "%i%s", &result, NULL);
+    else
+        media_uv_policy_drop_conn(conn);
 
-    media_uv_disconnect(priv->proxy, media_uv_policy_release_cb);
+    cb(cookie1, result);
+    media_uv_policy_put_conn(conn);
 }
 
 static void media_uv_policy_receive_int_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel)
 {
     media_uv_int_callback cb = cookie0;
-    MediaPolicyPriv* priv = cookie;
+    MediaPolicyConn* conn = cookie;
     const char* response = NULL;
     int32_t result = -ECANCELED;
     int value = 0;
 
-    if (cb) {
-        if (parcel) {
-            media_parcel_read_scanf(parcel, "%i%s", &result, &response);
-            if (response)
-                value = strtol(response, NULL, 0);
-        }
+    if (parcel) {
+        media_parcel_read_scanf(parcel, "%i%s", &result, &response);
+        if (response)
+            value = strtol(response, NULL, 0);
+    } else
+        media_uv_policy_drop_conn(conn);
 
-        cb(cookie1, result, value);
-    }
-
-    media_uv_disconnect(priv->proxy, media_uv_policy_release_cb);
+    cb(cookie1, result, value);
+    media_uv_policy_put_conn(conn);
 }
 
 static void media_uv_policy_receive_string_cb(void* cookie,
     void* cookie0, void* cookie1, media_parcel* parcel)
 {
     media_uv_string_callback cb = cookie0;
-    MediaPolicyPriv* priv = cookie;
+    MediaPolicyConn* conn = cookie;
     const char* response = NULL;
     int32_t result = -ECANCELED;
 
-    if (cb) {
-        if (parcel)
-            media_parcel_read_scanf(parcel, "%i%s", &result, &response);
-
-        cb(cookie1, result, response);
-    }
+    if (parcel)
+        media_parcel_read_scanf(parcel, "%i%s", &result, &response);
+    else
+        media_uv_policy_drop_conn(conn);
 
-    media_uv_disconnect(priv->proxy, media_uv_policy_release_cb);
+    cb(cookie1, result, response);
+    media_uv_policy_put_conn(conn);
 }
 
 /****************************************************************************
  * Public Basic Functions
  ****************************************************************************/
 
-int media_uv_policy_set_string(void* loop, const char* name,
-    const char* value, int apply, media_uv_callback cb, void* cookie)
+int media_uv_policy_close(void* loop)
 {
-    MediaPolicyPriv* priv;
+    MediaPolicyConn* conn;
+    void* proxy;
+    int pending;
 
-    priv = media_uv_policy_alloc(name, "set_string", value, apply, 0,
-        media_uv_policy_receive_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
+    pthread_mutex_lock(&g_media_uv_policy_mutex);
+    TAILQ_FOREACH(conn, &g_media_uv_policy_conns, entry)
+    {
+        if (conn->loop == loop)
+            break;
     }
+    pthread_mutex_unlock(&g_media_uv_policy_mutex);
+
+    if (!conn)
+        return -ENOENT;
+
+    /* Requests not answered yet are dropped without callback,
+     * conn might be freed once dropped. */
 
-    MEDIA_DEBUG("handle:%p %s %s %s.",
-        priv->proxy, name, "set_string", value ? value : "_");
+    proxy = conn->proxy;
+    pending = conn->pending;
+    media_uv_policy_drop_conn(conn);
+    if (pending > 0)
+        media_uv_disconnect(proxy, media_uv_policy_release_cb);
 
     return 0;
 }
 
-int media_uv_policy_get_string(void* loop, const char* name,
-    media_uv_string_callback cb, void* cookie)
+int media_uv_policy_set_string(void* loop, const char* name,
+    const char* value, int apply, media_uv_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
+    return media_uv_policy_request(loop, name, "set_string", value, apply, 0,
+        media_uv_policy_receive_cb, cb, cookie);
+}
 
-    priv = media_uv_policy_alloc(name, "get_string", NULL, 0, 128,
-        media_uv_policy_receive_string_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
+int media_uv_policy_batch(void* loop, const media_policy_change_t* changes,
+    int nb, int apply, media_uv_callback cb, void* cookie)
+{
+    char* arg;
+    int ret;
 
-    MEDIA_DEBUG("handle:%p %s %s.", priv->proxy, name, "get_string");
+    arg = media_policy_batch_encode(changes, nb);
+    if (!arg)
+        return -EINVAL;
 
-    return 0;
+    ret = media_uv_policy_request(loop, NULL, "batch", arg, apply, 0,
+        media_uv_policy_receive_cb, cb, cookie);
+    free(arg);
+    return ret;
+}
+
+int media_uv_policy_get_string(void* loop, const char* name,
+    media_uv_string_callback cb, void* cookie)
+{
+    return media_uv_policy_request(loop, name, "get_string", NULL, 0, 128,
+        media_uv_policy_receive_string_cb, cb, cookie);
 }
 
 int media_uv_policy_set_int(void* loop, const char* name,
     int value, int apply, media_uv_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
     char tmp[32];
 
     snprintf(tmp, sizeof(tmp), "%d", value);
-    priv = media_uv_policy_alloc(name, "set_int", tmp, apply, 0,
+    return media_uv_policy_request(loop, name, "set_int", tmp, apply, 0,
         media_uv_policy_receive_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s %d.", priv->proxy, name, "set_int", value);
-
-    return 0;
 }
 
 int media_uv_policy_get_int(void* loop, const char* name,
     media_uv_int_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
-
-    priv = media_uv_policy_alloc(name, "get_int", NULL, 0, 128,
+    return media_uv_policy_request(loop, name, "get_int", NULL, 0, 128,
         media_uv_policy_receive_int_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s.", priv->proxy, name, "get_int");
-
-    return 0;
 }
 
 int media_uv_policy_increase(void* loop, const char* name, int apply,
     media_uv_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
-
-    priv = media_uv_policy_alloc(name, "increase", NULL, apply, 0,
+    return media_uv_policy_request(loop, name, "increase", NULL, apply, 0,
         media_uv_policy_receive_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s.", priv->proxy, name, "increase");
-
-    return 0;
 }
 
 int media_uv_policy_decrease(void* loop, const char* name, int apply,
     media_uv_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
-
-    priv = media_uv_policy_alloc(name, "decrease", NULL, apply, 0,
+    return media_uv_policy_request(loop, name, "decrease", NULL, apply, 0,
         media_uv_policy_receive_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s.", priv->proxy, name, "decrease");
-
-    return 0;
 }
 
 int media_uv_policy_include(void* loop, const char* name,
     const char* value, int apply, media_uv_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
-
-    priv = media_uv_policy_alloc(name, "include", value, apply, 0,
+    return media_uv_policy_request(loop, name, "include", value, apply, 0,
         media_uv_policy_receive_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s %s.",
-        priv->proxy, name, "include", value ? value : "_");
-
-    return 0;
 }
 
 int media_uv_policy_exclude(void* loop, const char* name,
     const char* value, int apply, media_uv_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
-
-    priv = media_uv_policy_alloc(name, "exclude", value, apply, 0,
+    return media_uv_policy_request(loop, name, "exclude", value, apply, 0,
         media_uv_policy_receive_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s %s.",
-        priv->proxy, name, "exclude", value ? value : "_");
-
-    return 0;
 }
 
 int media_uv_policy_contain(void* loop, const char* name, const char* value,
     media_uv_int_callback cb, void* cookie)
 {
-    MediaPolicyPriv* priv;
-
-    priv = media_uv_policy_alloc(name, "contain", value, 0, 128,
+    return media_uv_policy_request(loop, name, "contain", value, 0, 128,
         media_uv_policy_receive_int_cb, cb, cookie);
-    if (!priv)
-        return -ENOMEM;
-
-    priv->proxy = media_uv_connect(loop, media_get_cpuname(),
-        media_uv_policy_connect_cb, priv);
-    if (!priv->proxy) {
-        media_uv_policy_free(priv);
-        return -ENOMEM;
-    }
-
-    MEDIA_DEBUG("handle:%p %s %s %s.",
-        priv->proxy, name, "contain", value ? value : "_");
-
-    return 0;
 }
 
 /****************************************************************************
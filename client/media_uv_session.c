@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <media_session.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "media_common.h"
 #include "media_metadata.h"
@@ -42,6 +43,7 @@ typedef struct MediaSessionPriv {
     media_event_callback on_event;
     media_metadata_t data;
     bool need_query;
+    int query_len;
 } MediaSessionPriv;
 
 /****************************************************************************
@@ -105,11 +107,12 @@ static void media_uv_session_event_cb(void* cookie, void* cookie0,
         media_parcel_read_scanf(parcel, "%i%i%s", &event,
             &result, &response);
 
+    /* Events carry the metadata, query again only if it's missing. */
     if (event == MEDIA_EVENT_CHANGED) {
         media_metadata_reinit(&priv->data);
-        priv->need_query = true;
-    } else if (event == MEDIA_EVENT_UPDATED)
-        priv->need_query = true;
+        priv->need_query = media_metadata_apply(&priv->data, response) < 0;
+    } else if (event == MEDIA_EVENT_UPDATED && !priv->need_query)
+        priv->need_query = media_metadata_apply(&priv->data, response) < 0;
 
     priv->on_event(priv->cookie, event, result, response);
 }
@@ -156,18 +159,27 @@ static void media_uv_controller_receive_metadata_cb(void* cookie,
     MediaSessionPriv* priv = cookie;
     int32_t result = -ECANCELED;
     const char* response = NULL;
-    media_metadata_t diff;
 
     if (parcel)
         media_parcel_read_scanf(parcel, "%i%s", &result, &response);
 
-    if (result < 0)
+    /* Strings have no length limit, ask again with a larger reply. */
+    if (result == -E2BIG && priv->query_len < MEDIA_METADATA_QUERY_MAX) {
+        priv->query_len *= 2;
+        result = media_uv_session_send(priv, NULL, "query", NULL,
+            priv->query_len, media_uv_controller_receive_metadata_cb,
+            cb, cookie1);
+        if (result >= 0)
+            return;
+    }
+
+    if (result < 0) {
         cb(cookie1, result, NULL);
+        return;
+    }
 
     /* Update metadata and notify controller user. */
-    media_metadata_init(&diff);
-    media_metadata_unserialize(&diff, response);
-    media_metadata_update(&priv->data, &diff);
+    media_metadata_apply(&priv->data, response);
     cb(cookie1, 0, &priv->data);
 }
 
@@ -307,7 +319,8 @@ int media_uv_session_query(void* handle,
         return 0;
     }
 
-    ret = media_uv_session_send(handle, NULL, "query", NULL, 256,
+    priv->query_len = MEDIA_METADATA_QUERY_SIZE;
+    ret = media_uv_session_send(handle, NULL, "query", NULL, priv->query_len,
         media_uv_controller_receive_metadata_cb, on_query, cookie);
     if (ret < 0)
         return ret;
@@ -497,12 +510,20 @@ int media_uv_session_notify(void* handle, int event, int result, const char* ext
 int media_uv_session_update(void* handle, const media_metadata_t* data,
     media_uv_callback on_update, void* cookie)
 {
-    char tmp[256];
+    char* tmp;
+    int len, ret;
 
     if (!handle || !data)
         return -EINVAL;
 
-    media_metadata_serialize(data, tmp, sizeof(tmp));
-    return media_uv_session_send(handle, NULL, "update", tmp, 0,
+    len = media_metadata_serialize(data, NULL, 0) + 1;
+    tmp = malloc(len);
+    if (!tmp)
+        return -ENOMEM;
+
+    media_metadata_serialize(data, tmp, len);
+    ret = media_uv_session_send(handle, NULL, "update", tmp, 0,
         media_uv_session_receive_cb, on_update, cookie);
+    free(tmp);
+    return ret;
 }
@@ -26,6 +26,7 @@ static const char* file_tag = "[jidl_feature] audio_impl";
 #define MAX_ALBUM_LEN 64
 #define MAX_ARTIST_LEN 64
 #define MAX_STREAMTYPE_LEN 10
+#define TIMEUPDATE_INTERVAL 250
 
 #define MEDIA_STATE_STARTED 0
 #define MEDIA_STATE_PAUSED 1
@@ -53,6 +54,7 @@ typedef struct {
     FeatureInstanceHandle feature;
     Event event;
     uv_timer_t timer;
+    bool progress; /* Position events pushed by server, no polling. */
 
     char src[MAX_URL_LEN];
     MetaInfo meta;
@@ -139,6 +141,7 @@ static void init_audio_obj(AudioObject* obj)
     obj->volume = 1;
     obj->autoplay = false;
     obj->loop = false;
+    obj->progress = false;
 }
 
 static const char* get_state_string(int state)
@@ -184,7 +187,19 @@ static void timeupdate_loop_timer(AudioObject* obj)
 
     uv_timer_init(loop, &obj->timer);
     obj->timer.data = obj;
-    uv_timer_start(&obj->timer, timeupdate_timer_cb, 0, 250);
+    uv_timer_start(&obj->timer, timeupdate_timer_cb, 0, TIMEUPDATE_INTERVAL);
+}
+
+static void update_current_time(AudioObject* obj, const char* data)
+{
+    unsigned position;
+
+    if (!data || sscanf(data, "%u", &position) != 1)
+        return;
+
+    obj->currentTime = position / 1000;
+    if (FeatureCheckCallbackId(obj->feature, obj->event.ontimeupdate))
+        FeatureInvokeCallback(obj->feature, obj->event.ontimeupdate);
 }
 
 static void update_duration(AudioObject* obj)
@@ -223,7 +238,8 @@ static void system_audio_event_callback(void* cookie, int event, int ret, const
         if (FeatureCheckCallbackId(obj->feature, obj->event.onplay))
             FeatureInvokeCallback(obj->feature, obj->event.onplay);
         update_duration(obj);
-        timeupdate_loop_timer(obj);
+        if (!obj->progress)
+            timeupdate_loop_timer(obj);
         break;
     case MEDIA_EVENT_PAUSED:
         obj->state = MEDIA_STATE_PAUSED;
@@ -240,6 +256,9 @@ static void system_audio_event_callback(void* cookie, int event, int ret, const
         if (FeatureCheckCallbackId(obj->feature, obj->event.onended))
             FeatureInvokeCallback(obj->feature, obj->event.onended);
         break;
+    case MEDIA_EVENT_POSITION:
+        update_current_time(obj, data);
+        break;
 
     default:
         break;
@@ -271,6 +290,19 @@ fail:
     init_audio_obj(obj);
 }
 
+static void audio_uv_progress_cb(void* cookie, int ret)
+{
+    FEATURE_LOG_DEBUG("%s::%s(), ret: %d\n", file_tag, __FUNCTION__, ret);
+    AudioObject* obj;
+
+    obj = (AudioObject*)cookie;
+    if (!obj)
+        return;
+
+    /* Server without TIMER_FD, poll position by timer instead. */
+    obj->progress = ret >= 0;
+}
+
 static void audio_uv_open_cb(void* cookie, int ret)
 {
     FEATURE_LOG_DEBUG("%s::%s(), ret: %d\n", file_tag, __FUNCTION__, ret);
@@ -287,6 +319,11 @@ static void audio_uv_open_cb(void* cookie, int ret)
     if (ret < 0)
         goto fail;
 
+    ret = media_uv_player_set_progress_interval(obj->handle,
+        TIMEUPDATE_INTERVAL, audio_uv_progress_cb, obj);
+    if (ret < 0)
+        goto fail;
+
     ret = media_uv_player_prepare(obj->handle, obj->src, NULL,
         NULL, audio_uv_prepare_cb, obj);
     if (ret < 0)
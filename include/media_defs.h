@@ -21,6 +21,13 @@
 #ifndef FRAMEWORKS_MEDIA_INCLUDE_MEDIA_DEFS_H
 #define FRAMEWORKS_MEDIA_INCLUDE_MEDIA_DEFS_H
 
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -68,6 +75,23 @@ extern "C" {
 #define MEDIA_EVENT_SEEKED 5 /* SEEKED is not a state. */
 #define MEDIA_EVENT_COMPLETED 6
 
+/* Buffer level crossed watermark, used by player&recorder in buffer mode,
+ * result is the buffer level in bytes. */
+
+#define MEDIA_EVENT_BUFFER_LOW 21 /* Player: queued data below watermark. */
+#define MEDIA_EVENT_BUFFER_HIGH 22 /* Recorder: ready data above watermark. */
+
+/* Switched to source queued by `media_player_queue_next`, used by player. */
+
+#define MEDIA_EVENT_SWITCHED 23
+
+/* Playback progress pushed by `media_player_set_progress_interval`,
+ * extra is "position:timestamp:rate": position in ms, CLOCK_MONOTONIC ms
+ * when position was got, and rate in permille (1000 while playing, 0 when
+ * paused or stopped), so position can be extrapolated between events. */
+
+#define MEDIA_EVENT_POSITION 24
+
 /* Control message and its result, used by session. */
 
 #define MEDIA_EVENT_CHANGED 101 /* Controllee changed (auto generate). */
@@ -139,6 +163,15 @@ typedef void (*media_focus_callback)(int suggestion, void* cookie);
 #define MEDIA_POLICY_APPLY 1
 #define MEDIA_POLICY_NOT_APPLY 0
 
+/* Criterion change commands, for media_policy_batch. */
+
+#define MEDIA_POLICY_SET_INT "set_int"
+#define MEDIA_POLICY_SET_STRING "set_string"
+#define MEDIA_POLICY_INCLUDE "include"
+#define MEDIA_POLICY_EXCLUDE "exclude"
+#define MEDIA_POLICY_INCREASE "increase"
+#define MEDIA_POLICY_DECREASE "decrease"
+
 #define MEDIA_POLICY_AUDIO_MODE "AudioMode"
 #define MEDIA_POLICY_DEVICE_USE "UsingDevices"
 #define MEDIA_POLICY_DEVICE_AVAILABLE "AvailableDevices"
@@ -174,6 +207,17 @@ typedef void (*media_focus_callback)(int suggestion, void* cookie);
 typedef void (*media_policy_change_callback)(void* cookie,
     int number, const char* literal);
 
+/**
+ * @brief One criterion change of a policy batch.
+ *
+ * Names and values should not contain tab or line feed.
+ */
+typedef struct media_policy_change_t {
+    const char* cmd; /*!< MEDIA_POLICY_SET_INT, MEDIA_POLICY_INCLUDE, ... */
+    const char* name; /*!< Criterion name. */
+    const char* value; /*!< Decimal for SET_INT, NULL for INCREASE/DECREASE. */
+} media_policy_change_t;
+
 /****************************************************************************
  * Scenario Definitions
  ****************************************************************************/
@@ -235,6 +279,7 @@ typedef void (*media_policy_change_callback)(void* cookie,
 #define MEDIA_METAFLAG_TITLE 0x10
 #define MEDIA_METAFLAG_ARTIST 0x20
 #define MEDIA_METAFLAG_ALBUM 0x40
+#define MEDIA_METAFLAG_LATENCY 0x80
 
 typedef struct media_metadata_s {
     int flags; /* Indicates available fields. */
@@ -242,11 +287,50 @@ typedef struct media_metadata_s {
     int volume;
     unsigned position;
     unsigned duration;
+    unsigned latency;
     char* title;
     char* artist;
     char* album;
 } media_metadata_t;
 
+/****************************************************************************
+ * Status Definitions
+ ****************************************************************************/
+
+#define MEDIA_STATUS_STREAM_LEN 32
+#define MEDIA_STATUS_NAME_LEN 32
+#define MEDIA_STATUS_LITERAL_LEN 128
+
+/* Player status published by mediad, see `media_player_get_status`. */
+
+typedef struct media_player_status_s {
+    uint32_t id; /* Nonzero while player is opened, differs on each open. */
+    int32_t state; /* Last MEDIA_EVENT_PREPARED/STARTED/PAUSED/STOPPED/COMPLETED. */
+    int32_t volume; /* Stream volume, negative if unknown. */
+    uint32_t position; /* In ms, got at `timestamp`. */
+    uint32_t duration; /* In ms. */
+    uint64_t timestamp; /* CLOCK_MONOTONIC in ms. */
+    char stream[MEDIA_STATUS_STREAM_LEN]; /* MEDIA_STREAM_* or filter name. */
+} media_player_status_t;
+
+/* Criterion state published by mediad, see `media_policy_get_status`. */
+
+typedef struct media_policy_status_s {
+    char name[MEDIA_STATUS_NAME_LEN]; /* Criterion name, empty if unused. */
+    int32_t number; /* Numerical state, bitmask for inclusive criteria. */
+    char literal[MEDIA_STATUS_LITERAL_LEN]; /* e.g. "Music|Ring", truncated. */
+} media_policy_status_t;
+
+/****************************************************************************
+ * Buffer Mode Definitions
+ ****************************************************************************/
+
+typedef struct media_buffer_status_s {
+    size_t size; /* Capacity of data socket, zero if unknown. */
+    size_t level; /* Player: queued bytes; Recorder: bytes ready to read. */
+    unsigned underruns; /* Player: queue drained; Recorder: queue full. */
+} media_buffer_status_t;
+
 /****************************************************************************
  * Async Callback Definitions
  ****************************************************************************/
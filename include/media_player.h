@@ -28,6 +28,8 @@
 #include <media_defs.h>
 #include <stddef.h>
 #include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 #define EXTERN extern "C"
@@ -123,6 +125,25 @@ int media_player_set_event_callback(void* handle, void* event_cookie,
  */
 int media_player_prepare(void* handle, const char* url, const char* options);
 
+/**
+ * @brief Queue next source to play right after current one completes.
+ *
+ * @param[in] handle    Player handle.
+ * @param[in] url       Path of next source, NULL to cancel the queued one.
+ *                      Buffer mode is not supported.
+ * @param[in] options   Extra options about next source, same as prepare.
+ * @return int  Zero on success; a negated errno value on failure.
+ *
+ * @note Next source is opened and its decoder primed at once by the player
+ * filter, which continues its output with it at end of current one, so
+ * the switch is sample accurate. With a filter lacking that, the source
+ * is probed on another input of the same stream and started by server at
+ * end of current one, leaving a small gap. Either way
+ * MEDIA_EVENT_SWITCHED is notified instead of MEDIA_EVENT_COMPLETED.
+ * Queue again replaces the pending one; prepare/stop/reset drop it.
+ */
+int media_player_queue_next(void* handle, const char* url, const char* options);
+
 /**
  * @brief Reset media with player type.
  * @param[in] handle The player path, return value of media_player_open
@@ -153,6 +174,61 @@ int media_player_reset(void* handle);
  */
 ssize_t media_player_write_data(void* handle, const void* data, size_t len);
 
+/**
+ * @brief Write scattered buffers to media for playing in one call.
+ *
+ * @param[in] handle    Player handle.
+ * @param[in] iov       Buffer vector.
+ * @param[in] iovcnt    Number of buffers in `iov`.
+ * @return ssize_t  Sent length on success; a negated errno value on failure.
+ *
+ * @note Same as `media_player_write_data`, but saves merging
+ * header/payload or ring buffer segments into a temporary buffer.
+ */
+ssize_t media_player_writev(void* handle, const struct iovec* iov, int iovcnt);
+
+/**
+ * @brief Write data from a file descriptor to media for playing.
+ *
+ * @param[in] handle    Player handle.
+ * @param[in] fd        File descriptor opened for reading.
+ * @param[in,out] offset    Read offset in `fd`, updated on return;
+ *                      NULL to read from and advance current file offset.
+ * @param[in] len       Max length to send.
+ * @return ssize_t  Sent length on success, zero at end of file;
+ *                  a negated errno value on failure.
+ *
+ * @note Data is moved by `sendfile()`, no user space copy is needed,
+ * call it in a loop until zero returned to play the whole file; a short
+ * count or -EAGAIN/-EINTR keeps the stream, just call it again.
+ */
+ssize_t media_player_write_fd(void* handle, int fd, off_t* offset, size_t len);
+
+/**
+ * @brief Set low watermark of data queued to server in buffer mode.
+ *
+ * @param[in] handle    Player handle.
+ * @param[in] low       Watermark in bytes, zero to disable.
+ * @return int  Zero on success; a negated errno value on failure.
+ *
+ * @note The level is tracked by the server filter reading the data socket,
+ * once set it sends MEDIA_EVENT_BUFFER_LOW when level drops below `low`;
+ * -ENOSYS if the filter doesn't track it.
+ */
+int media_player_set_buffer_watermark(void* handle, size_t low);
+
+/**
+ * @brief Get level of data queued to server in buffer mode.
+ *
+ * @param[in] handle    Player handle.
+ * @param[out] status   Buffer capacity, level and underrun count.
+ * @return int  Zero on success; a negated errno value on failure.
+ *
+ * @note Reported by the server filter, `underruns` counts reads which found
+ * the queue empty while playing; -ENOSYS if the filter doesn't track it.
+ */
+int media_player_get_buffer_status(void* handle, media_buffer_status_t* status);
+
 /**
  * @brief Get socket address info for buffer mode.
  *
@@ -233,6 +309,19 @@ int media_player_seek(void* handle, unsigned int position);
  */
 int media_player_set_looping(void* handle, int loop);
 
+/**
+ * @brief Let server push playback progress instead of polling position.
+ *
+ * @param[in] handle    Player handle.
+ * @param[in] interval  Interval of MEDIA_EVENT_POSITION in ms while
+ *                      playing, 0 to stop pushing.
+ * @return int  Zero on success; a negated errno value on failure.
+ *
+ * @note Position is also pushed once at start, pause, stop, seek and
+ * completion, see MEDIA_EVENT_POSITION for format of `extra`.
+ */
+int media_player_set_progress_interval(void* handle, unsigned int interval);
+
 /**
  * @brief Check playing status.
  *
@@ -318,6 +407,101 @@ int media_player_set_property(void* handle, const char* target,
 int media_player_get_property(void* handle, const char* target,
     const char* key, char* value, int value_len);
 
+/**
+ * @brief Open a sound pool for low latency playback of short clips.
+ *
+ * @param[in] stream    MEDIA_STREAM_*, should be routed to a mixing input
+ *                      of graph, the pool holds one such input.
+ * @return void*    Pool handle, NULL on failure.
+ *
+ * @code
+ *  // at boot, decode clips once into server memory.
+ *  pool = media_player_open_sound_pool(MEDIA_STREAM_NOTIFICATION);
+ *  click = media_player_load_sound(pool, "/data/click.wav");
+ *
+ *  // on each key press, one message without waiting for reply.
+ *  media_player_play_sound(pool, click);
+ *
+ *  // at exit, unloads all clips.
+ *  media_player_close_sound_pool(pool);
+ * @endcode
+ */
+void* media_player_open_sound_pool(const char* stream);
+
+/**
+ * @brief Decode a clip into sound pool.
+ *
+ * @param[in] pool      Pool handle.
+ * @param[in] url       Path of the clip.
+ * @return int  Clip id on success; a negated errno value on failure.
+ *
+ * @note Decoded PCM is kept in server memory, shared by pools loading the
+ * same url. Server decodes in its main loop, so clips should be short, it
+ * fails with -E2BIG above CONFIG_MEDIA_SOUND_POOL_CLIP_SIZE.
+ */
+int media_player_load_sound(void* pool, const char* url);
+
+/**
+ * @brief Play a loaded clip from the beginning.
+ *
+ * @param[in] pool      Pool handle.
+ * @param[in] id        Clip id.
+ * @return int  Zero if the request is sent; a negated errno value on failure.
+ *
+ * @note Server does not reply. Clips played at once are mixed, up to
+ * CONFIG_MEDIA_SOUND_POOL_VOICES, beyond that the one played the longest
+ * is cut.
+ */
+int media_player_play_sound(void* pool, int id);
+
+/**
+ * @brief Unload a clip from sound pool, stops it if playing.
+ *
+ * @param[in] pool      Pool handle.
+ * @param[in] id        Clip id.
+ * @return int  Zero on success; a negated errno value on failure.
+ */
+int media_player_unload_sound(void* pool, int id);
+
+/**
+ * @brief Close a sound pool, unloads all its clips.
+ *
+ * @param[in] pool      Pool handle.
+ * @return int  Zero on success; a negated errno value on failure.
+ */
+int media_player_close_sound_pool(void* pool);
+
+/**
+ * @brief Get number of player status records published by mediad.
+ *
+ * @return int  Number of records; a negated errno value on failure.
+ *
+ * @note Status page is in shared memory, only for clients on the same
+ * cpu as mediad with CONFIG_MEDIA_STATUS_PLAYERS enabled.
+ */
+int media_player_get_status_count(void);
+
+/**
+ * @brief Read a player status record without any RPC.
+ *
+ * @param[in] index     Record index, less than `media_player_get_status_count`.
+ * @param[out] status   Consistent copy of the record.
+ * @return int  Zero on success, -ENOENT if no player holds the record;
+ *              a negated errno value on failure.
+ *
+ * @note Position is got at `timestamp`, add the elapsed time while state
+ * is MEDIA_EVENT_STARTED to estimate current position.
+ *
+ * @code
+ *  for (i = 0; i < media_player_get_status_count(); i++) {
+ *      if (media_player_get_status(i, &status) < 0)
+ *          continue;
+ *      // draw status.stream, status.state, status.position...
+ *  }
+ * @endcode
+ */
+int media_player_get_status(int index, media_player_status_t* status);
+
 #ifdef CONFIG_LIBUV
 /**
  * @brief Open an async player with given stream type.
@@ -414,6 +598,21 @@ int media_uv_player_prepare(void* handle, const char* url, const char* options,
  */
 int media_uv_player_reset(void* handle, media_uv_callback on_reset, void* cookie);
 
+/**
+ * @brief Queue next source to play right after current one completes.
+ *
+ * @param[in] handle    Async player handle.
+ * @param[in] url       Path of next source, NULL to cancel the queued one.
+ * @param[in] options   Extra options about next source.
+ * @param[in] on_queue  Call after queue is done.
+ * @param[in] cookie    One-time callback context.
+ * @return int  Zero on success; a negated errno value on failure.
+ *
+ * @note Same as `media_player_queue_next`.
+ */
+int media_uv_player_queue_next(void* handle, const char* url, const char* options,
+    media_uv_callback on_queue, void* cookie);
+
 /**
  * @brief  Play or resume the prepared source with auto focus request.
  *
@@ -423,6 +622,10 @@ int media_uv_player_reset(void* handle, media_uv_callback on_reset, void* cookie
  * @param[out] on_play  Callback to acknowledge result of request/start.
  * @param[in] cookie    Callback argument for `on_play`.
  * @return int  Zero on success, negative errno on failure.
+ *
+ * @note Focus is requested and its suggestions (volume/duck/pause/stop)
+ * are applied by server in one command; the focus is abandoned by server
+ * on pause/stop/reset/close or completion.
  */
 int media_uv_player_start_auto(void* handle, const char* scenario,
     media_uv_callback on_start, void* cookie);
@@ -541,6 +744,22 @@ int media_uv_player_get_latency(void* handle,
 int media_uv_player_set_looping(void* handle, int loop,
     media_uv_callback on_looping, void* cookie);
 
+/**
+ * @brief Let server push playback progress instead of polling position.
+ *
+ * @param[in] handle        Async player handle.
+ * @param[in] interval      Interval of MEDIA_EVENT_POSITION in ms while
+ *                          playing, 0 to stop pushing.
+ * @param[out] on_progress  Call after receiving result.
+ * @param[in] cookie        Callback argument for `on_progress`.
+ * @return int  Zero on success; a negated errno value on failure.
+ *
+ * @note Position is also pushed once at start, pause, stop, seek and
+ * completion, see MEDIA_EVENT_POSITION for format of `extra`.
+ */
+int media_uv_player_set_progress_interval(void* handle, unsigned int interval,
+    media_uv_callback on_progress, void* cookie);
+
 /**
  * @brief Seek to msec position from begining.
  *
@@ -590,6 +809,8 @@ int media_uv_player_get_property(void* handle, const char* target, const char* k
  *
  * @note Each player handle has unique media_metadata_s;
  * This api only update the content, won't changing address of metadata.
+ * @note State, volume, position, duration and latency are got by one
+ * request, `ret` of `on_query` is flags of the updated fields.
  *
  * @code
  *  void on_query(void* cookie, int ret, void* object) {
@@ -262,6 +262,8 @@ int media_policy_set_int(const char* name, int value, int apply);
  *
  * @note This api is only for certain service, if you are not sure
  * whether you need this API, then you definitely don't need.
+ * @note With CONFIG_MEDIA_POLICY_CACHE_ENTRIES, get_int, get_string and
+ * contain are answered locally once read, until mediad notifies a change.
  */
 int media_policy_get_int(const char* name, int* value);
 
@@ -291,6 +293,31 @@ int media_policy_get_range(const char* name, int* min_value, int* max_value);
  */
 int media_policy_set_string(const char* name, const char* value, int apply);
 
+/**
+ * @brief Make several criterion changes at once.
+ *
+ * Changes are made in order by the server, if one fails, the ones before
+ * are rolled back and nothing is applied. Rules are evaluated only once
+ * when apply is set, instead of once per change.
+ *
+ * @code
+ *  media_policy_change_t changes[] = {
+ *      { MEDIA_POLICY_SET_STRING, MEDIA_POLICY_AUDIO_MODE, "phone" },
+ *      { MEDIA_POLICY_EXCLUDE, MEDIA_POLICY_DEVICE_USE, "a2dp" },
+ *      { MEDIA_POLICY_SET_INT, "MusicVolume", "5" },
+ *  };
+ *
+ *  media_policy_batch(changes, 3, 1);
+ * @endcode
+ *
+ * @param[in] changes   Changes, names and values must not contain '\t'
+ *                      or '\n'.
+ * @param[in] nb        Number of changes.
+ * @param[in] apply     Whether apply changes to policy.
+ * @return int  Zero on success; a negative errno value on failure.
+ */
+int media_policy_batch(const media_policy_change_t* changes, int nb, int apply);
+
 /**
  * @brief Get literal value from criterion.
  *
@@ -388,7 +415,33 @@ void* media_policy_subscribe(const char* name,
  */
 int media_policy_unsubscribe(void* handle);
 
+/**
+ * @brief Read a criterion published in mediad status page without RPC.
+ *
+ * @param[in] name      Criterion name, one of CONFIG_MEDIA_STATUS_CRITERIA,
+ *                      e.g. "ActiveStreams" for the streams now playing.
+ * @param[out] status   Consistent copy of the criterion state.
+ * @return Zero for success, -ENOENT if not published, negative on failure.
+ *
+ * @note Status page is in shared memory, only for clients on the same
+ * cpu as mediad with CONFIG_MEDIA_STATUS_PLAYERS enabled. Literal is
+ * truncated to MEDIA_STATUS_LITERAL_LEN.
+ */
+int media_policy_get_status(const char* name, media_policy_status_t* status);
+
 #ifdef CONFIG_LIBUV
+/**
+ * @brief Close the policy connection of a loop.
+ *
+ * All media_uv_policy_* calls of one loop share a connection, which is
+ * created on first call and kept afterwards without keeping the loop
+ * alive. Call this before uv_loop_close.
+ *
+ * @param[in] loop      Loop handle of current thread.
+ * @return int  Zero on sucess, negative errno on else.
+ */
+int media_uv_policy_close(void* loop);
+
 /**
  * @brief Set numerical value to a criterion.
  *
@@ -454,6 +507,20 @@ int media_uv_policy_increase(void* loop, const char* name, int apply,
 int media_uv_policy_set_string(void* loop, const char* name,
     const char* value, int apply, media_uv_callback cb, void* cookie);
 
+/**
+ * @brief Make several criterion changes at once.
+ *
+ * @param[in] loop      Loop handle of current thread.
+ * @param[in] changes   Changes, see media_policy_batch.
+ * @param[in] nb        Number of changes.
+ * @param[in] apply     Whether apply changes to policy configurations.
+ * @param[out] cb       Call after receiving result.
+ * @param[in] cookie    Callback argument.
+ * @return int  Zero on sucess, negative errno on else.
+ */
+int media_uv_policy_batch(void* loop, const media_policy_change_t* changes,
+    int nb, int apply, media_uv_callback cb, void* cookie);
+
 /**
  * @brief Get literal value of a criterion.
  *
@@ -28,6 +28,7 @@
 #include <media_defs.h>
 #include <stddef.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 #define EXTERN extern "C"
@@ -138,6 +139,47 @@ int media_recorder_reset(void* handle);
  */
 ssize_t media_recorder_read_data(void* handle, void* data, size_t len);
 
+/**
+ * @brief Read recorded data from recorder into scattered buffers.
+ *
+ * @attention This need media_recorder_prepare() url set to NULL.
+ * This function is blocked.
+ *
+ * @param[in] handle    Recorder handle.
+ * @param[in] iov       Buffer vector.
+ * @param[in] iovcnt    Number of buffers in `iov`.
+ * @return Read length on success; a negative errno value on failure.
+ *
+ * @note Same as `media_recorder_read_data`, useful to fill both
+ * segments of a wrapped ring buffer in one call.
+ */
+ssize_t media_recorder_readv(void* handle, const struct iovec* iov, int iovcnt);
+
+/**
+ * @brief Set high watermark of data ready to read in buffer mode.
+ *
+ * @param[in] handle    Recorder handle.
+ * @param[in] high      Watermark in bytes, zero to disable.
+ * @return int Zero on success; a negative errno value on failure.
+ *
+ * @note The level is tracked by the server filter writing the data socket,
+ * once set it sends MEDIA_EVENT_BUFFER_HIGH when level rises above `high`;
+ * -ENOSYS if the filter doesn't track it.
+ */
+int media_recorder_set_buffer_watermark(void* handle, size_t high);
+
+/**
+ * @brief Get level of data ready to read in buffer mode.
+ *
+ * @param[in] handle    Recorder handle.
+ * @param[out] status   Buffer capacity, level and overrun count.
+ * @return int Zero on success; a negative errno value on failure.
+ *
+ * @note Reported by the server filter, `underruns` counts overruns here:
+ * writes which found the queue full; -ENOSYS if the filter doesn't track it.
+ */
+int media_recorder_get_buffer_status(void* handle, media_buffer_status_t* status);
+
 /**
  * @brief Get socket address info for buffer mode.
  *
@@ -82,13 +82,15 @@ int media_session_close(void* handle);
  *  void user_on_event(void* cookie, int event, int result, cosnt char* extra) {
  *      switch (event) {
  *      case MEDIA_EVENT_CHANGED:
- *          // The most active controllee changed, you should clear
- *          // the metadata you queried, and query again (if you cares).
+ *          // The most active controllee changed, its metadata is
+ *          // already in handle, `media_session_query` returns it
+ *          // without a round trip.
  *          break;
  *
  *      case MEDIA_EVENT_UPDATED:
- *          // The most active controllee updated its metadata, also
- *          // you should query again (if you cares).
+ *          // The most active controllee updated its metadata, `result`
+ *          // is MEDIA_METAFLAG_* of the changed fields, which are
+ *          // already applied to the metadata in handle.
  *          break;
  *
  *      case MEDIA_EVENT_START:
@@ -195,6 +197,8 @@ int media_session_set_volume(void* handle, int volume);
  *
  * @note Each controller handle has unique media_metadata_s;
  * This api only update the content, won't changing address of metadata.
+ * @note With an event callback set, metadata carried by CHANGED and
+ * UPDATED events keeps it fresh, only the first query asks the server.
  *
  * @code
  *  const media_metadata_t* data = NULL;
@@ -303,6 +307,9 @@ int media_session_notify(void* handle, int event, int result, const char* extra)
  * @param[in] handle    Controllee handle.
  * @param[in] data      Metadata to update.
  * @return int  Zero on success; a negative errno value on failure.
+ *
+ * @note Only fields in `data->flags` are sent and forwarded to
+ * controllers, set flags of the changed fields only.
  */
 int media_session_update(void* handle, const media_metadata_t* data);
 
@@ -1148,7 +1148,19 @@ static void* mediatool_buffer_thread(void* arg)
             return NULL;
     }
 
-    if (chain->type == MEDIATOOL_PLAYER) {
+    if (chain->type == MEDIATOOL_PLAYER && !chain->direct) {
+        /* Let framework splice file to data socket, no copy here. */
+        while (1) {
+            ret = media_player_write_fd(chain->handle, chain->fd, NULL, chain->size);
+            if (ret == 0) {
+                media_player_close_socket(chain->handle);
+                break;
+            } else if (ret < 0 && ret != -EINTR) {
+                printf("%s, error ret %d, line %d\n", __func__, ret, __LINE__);
+                goto out;
+            }
+        }
+    } else if (chain->type == MEDIATOOL_PLAYER) {
         while (1) {
             act = read(chain->fd, chain->buf, chain->size);
             assert(act >= 0);
@@ -1159,10 +1171,7 @@ static void* mediatool_buffer_thread(void* arg)
 
             tmp = chain->buf;
             while (act > 0) {
-                if (chain->direct)
-                    ret = mediatool_process_data(fd, true, tmp, act);
-                else
-                    ret = media_player_write_data(chain->handle, tmp, act);
+                ret = mediatool_process_data(fd, true, tmp, act);
 
                 if (ret == 0) {
                     break;
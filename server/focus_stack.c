@@ -23,8 +23,8 @@
 #include <debug.h>
 #include <errno.h>
 #include <nuttx/list.h>
-#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "focus_stack.h"
 #include "media_common.h"
@@ -40,13 +40,16 @@ typedef struct app_focus_node {
     struct app_focus_id focus_id;
 } app_focus_node;
 
-// struct for app focus stack
+// struct for app focus stack, node_list is indexed by client id and grows
+// on demand, nodes never move so list links stay valid across growing.
 
 typedef struct app_focus_stack {
     struct list_node head_node;
     int max_size;
     int cur_size;
-    struct app_focus_node* node_list;
+    struct app_focus_node** node_list;
+    int* free_ids;
+    int free_size;
     app_focus_change_callback focus_change_callback;
 } app_focus_stack;
 
@@ -54,12 +57,6 @@ typedef struct app_focus_stack {
  * Private Functions
  ****************************************************************************/
 
-// if such focus stack is full or not.
-static int app_focus_stack_is_full(app_focus_stack* s)
-{
-    return s->cur_size == s->max_size;
-}
-
 // if app focus stack is empty or not
 static int app_focus_stack_is_empty(app_focus_stack* s)
 {
@@ -80,31 +77,121 @@ static void app_focus_stack_change_callback(app_focus_stack* s,
     s->focus_change_callback(cur_focus_id, request_app_focus_id, callback_flag);
 }
 
-// reset node info in fixed node list
-static int app_focus_node_list_remove(app_focus_stack* s,
+// get node of client id in node list, NULL if client id not in stack
+static struct app_focus_node* app_focus_node_list_find(app_focus_stack* s,
     int input_client_id)
 {
-    if ((s->node_list + input_client_id)->focus_id.client_id != -1) {
-        (s->node_list + input_client_id)->focus_id.client_id = -1;
-        (s->node_list + input_client_id)->focus_id.focus_level = 0;
-        (s->node_list + input_client_id)->focus_id.thread_id = 0;
-        (s->node_list + input_client_id)->focus_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
-        (s->node_list + input_client_id)->focus_id.focus_callback = NULL;
-        (s->node_list + input_client_id)->focus_id.callback_argv = NULL;
+    struct app_focus_node* p_node;
+
+    if (input_client_id < 0 || input_client_id >= s->max_size) {
+        return NULL;
+    }
+    p_node = s->node_list[input_client_id];
+    if (p_node->focus_id.client_id == -1) {
+        return NULL;
+    }
+    return p_node;
+}
+
+// double node list capacity, new client ids are free ids
+static int app_focus_node_list_grow(app_focus_stack* s, int size)
+{
+    struct app_focus_node** node_list;
+    int* free_ids;
+    int i, j;
+
+    if (size <= s->max_size) {
         return 0;
     }
-    return -ENOENT;
+
+    node_list = realloc(s->node_list, size * sizeof(*node_list));
+    if (!node_list) {
+        return -ENOMEM;
+    }
+    s->node_list = node_list;
+
+    free_ids = realloc(s->free_ids, size * sizeof(*free_ids));
+    if (!free_ids) {
+        return -ENOMEM;
+    }
+    s->free_ids = free_ids;
+
+    for (i = s->max_size; i < size; i++) {
+        s->node_list[i] = malloc(sizeof(app_focus_node));
+        if (!s->node_list[i]) {
+            break;
+        }
+        list_initialize(&s->node_list[i]->node);
+        s->node_list[i]->focus_id.client_id = -1;
+        s->node_list[i]->focus_id.focus_level = 0;
+        s->node_list[i]->focus_id.thread_id = 0;
+        s->node_list[i]->focus_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
+        s->node_list[i]->focus_id.focus_callback = NULL;
+        s->node_list[i]->focus_id.callback_argv = NULL;
+        s->node_list[i]->focus_id.suggestion = -1;
+    }
+    if (i == s->max_size) {
+        return -ENOMEM;
+    }
+
+    // free ids popped from the end, keep lowest id at the end
+    memmove(s->free_ids + i - s->max_size, s->free_ids,
+        s->free_size * sizeof(*free_ids));
+    for (j = s->max_size; j < i; j++) {
+        s->free_ids[i - 1 - j] = j;
+    }
+    s->free_size += i - s->max_size;
+    s->max_size = i;
+    return 0;
+}
+
+// take client id node from node list and fill it with value
+static struct app_focus_node* app_focus_node_list_take(app_focus_stack* s,
+    app_focus_id* value)
+{
+    struct app_focus_node* p_node;
+    int i;
+
+    if (value->client_id < 0 || value->client_id >= s->max_size) {
+        return NULL;
+    }
+    p_node = s->node_list[value->client_id];
+    if (p_node->focus_id.client_id != -1) {
+        return NULL;
+    }
+
+    // client id is usually the one given by app_focus_free_client_id
+    for (i = s->free_size - 1; i >= 0; i--) {
+        if (s->free_ids[i] == value->client_id) {
+            s->free_ids[i] = s->free_ids[--s->free_size];
+            break;
+        }
+    }
+
+    p_node->focus_id = *value;
+    list_initialize(&p_node->node);
+    return p_node;
 }
 
-// check if app focus id's thread is alive or not
-static int app_focus_stack_thread_is_alive(app_focus_id* value)
+// reset node info in node list, client id becomes free
+static int app_focus_node_list_remove(app_focus_stack* s,
+    int input_client_id)
 {
-    pthread_t thread = (pthread_t)value->thread_id;
-    if (pthread_kill(thread, 0) == 0) {
+    struct app_focus_node* p_node;
+
+    p_node = app_focus_node_list_find(s, input_client_id);
+    if (p_node) {
+        p_node->focus_id.client_id = -1;
+        p_node->focus_id.focus_level = 0;
+        p_node->focus_id.thread_id = 0;
+        p_node->focus_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
+        p_node->focus_id.focus_callback = NULL;
+        p_node->focus_id.callback_argv = NULL;
+        p_node->focus_id.suggestion = -1;
+        s->free_ids[s->free_size++] = input_client_id;
         return 0;
-    } else {
-        return -ESRCH;
     }
+    return -ENOENT;
 }
 
 /****************************************************************************
@@ -164,26 +251,13 @@ int app_focus_stack_push(void* x, app_focus_id* value, int callback_flag)
 {
     app_focus_stack* s = (app_focus_stack*)x;
     struct app_focus_node* p_new_node;
-    int node_list_location = -1;
-
-    if (app_focus_stack_is_full(s)) {
-        return -ENOSPC;
-    }
-
-    // copy client id of value to the node list in valid location
-    node_list_location = value->client_id;
 
-    // if specific location can not found
-    if (node_list_location == -1) {
+    // get app focus node of client id in node list
+    p_new_node = app_focus_node_list_take(s, value);
+    if (!p_new_node) {
         return -EINVAL;
     }
 
-    // get app focus node location in node list
-    p_new_node = (s->node_list + node_list_location);
-    // apply value of pointer to node list
-    p_new_node->focus_id = *value;
-    list_initialize(&p_new_node->node);
-
     // casue the push operation already been checked outside, it should
     // be success with no doubt in different condition
 
@@ -212,21 +286,15 @@ int app_focus_stack_insert(void* x, app_focus_id* value, int index)
     struct app_focus_node* p_tmp_node;
     int node_list_location = -1;
 
-    if (app_focus_stack_is_full(s)) {
-        return -ENOSPC;
-    }
-
     if (app_focus_stack_is_empty(s)) {
         return app_focus_stack_push(s, value, index);
     } else {
         node_list_location = value->client_id;
 
-        if (node_list_location == -1) {
+        p_new_node = app_focus_node_list_take(s, value);
+        if (!p_new_node) {
             return -EINVAL;
         }
-        p_new_node = (s->node_list + node_list_location);
-        p_new_node->focus_id = *value;
-        list_initialize(&p_new_node->node);
 
         int count = 0;
         list_for_every_entry(&s->head_node,
@@ -247,85 +315,74 @@ int app_focus_stack_insert(void* x, app_focus_id* value, int index)
     }
 }
 
-int app_focus_stack_delete(void* x, app_focus_id* value, int callback_flag)
+int app_focus_stack_insert_level(void* x, app_focus_id* value)
 {
     app_focus_stack* s = (app_focus_stack*)x;
+    struct app_focus_node* p_new_node;
     struct app_focus_node* p_tmp_node;
-    struct app_focus_node* p_next_focus_node;
+    struct list_node* p_prev = NULL;
 
     if (app_focus_stack_is_empty(s)) {
-        return -ENOENT;
-    }
-    p_tmp_node = list_next_type(&s->head_node, &s->head_node, struct app_focus_node, node);
-
-    //  node need to be deleted at stack top
-    if (p_tmp_node->focus_id.client_id == value->client_id) {
-        value->focus_callback = p_tmp_node->focus_id.focus_callback;
-        value->callback_argv = p_tmp_node->focus_id.callback_argv;
-        return app_focus_stack_pop(s, value, callback_flag);
+        return app_focus_stack_push(s, value, 0);
     }
 
-    // node need to be deleted at stack under
-    list_for_every_entry_safe(&s->head_node,
+    // single walk from stack top, stop at first node with higher or same level
+    list_for_every_entry(&s->head_node,
         p_tmp_node,
-        p_next_focus_node,
         struct app_focus_node,
         node)
     {
-        if (p_tmp_node->focus_id.client_id == value->client_id) {
-            p_tmp_node->focus_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
-            value->focus_callback = p_tmp_node->focus_id.focus_callback;
-            value->callback_argv = p_tmp_node->focus_id.callback_argv;
-            list_delete(&p_tmp_node->node);
-            app_focus_node_list_remove(s, p_tmp_node->focus_id.client_id);
-            s->cur_size -= 1;
-            return 0;
+        if (value->focus_level <= p_tmp_node->focus_id.focus_level) {
+            break;
         }
+        p_prev = &p_tmp_node->node;
     }
-    return -ENOENT;
+
+    // no place under stack top, same as app_focus_stack_insert at index 0
+    if (!p_prev) {
+        return -ENOENT;
+    }
+
+    p_new_node = app_focus_node_list_take(s, value);
+    if (!p_new_node) {
+        return -EINVAL;
+    }
+    p_new_node->focus_id.focus_state = APP_FOCUS_STATE_STACK_UNDER;
+    list_add_head(p_prev, &p_new_node->node);
+    s->cur_size += 1;
+    return 0;
 }
 
-void app_focus_stack_useless_clear(void* x, int callback_flag)
+int app_focus_stack_delete(void* x, app_focus_id* value, int callback_flag)
 {
     app_focus_stack* s = (app_focus_stack*)x;
     struct app_focus_node* p_tmp_node;
-    struct app_focus_node* tmp_next_focus_node;
 
-    // interates app focus stack, delete every focus node one by one
-    if (!app_focus_stack_is_empty(s)) {
-        list_for_every_entry_safe(&s->head_node,
-            p_tmp_node,
-            tmp_next_focus_node,
-            struct app_focus_node,
-            node)
-        {
-            if (app_focus_stack_thread_is_alive(&p_tmp_node->focus_id) != 0) {
-
-                // kick off useless focus id from the stack
-                list_delete(&p_tmp_node->node);
-                if (p_tmp_node->focus_id.focus_state == APP_FOCUS_STATE_STACK_TOP) {
-
-                    // if only one stack exist, make top to null
-                    if (app_focus_stack_size(s) == 1) {
-                        list_initialize(&s->head_node);
-                    } else {
-                        tmp_next_focus_node->focus_id.focus_state = APP_FOCUS_STATE_STACK_TOP;
-                        if (app_focus_stack_thread_is_alive(&tmp_next_focus_node->focus_id) == 0) {
-
-                            // listener: move focus request from stack under to top
-                            app_focus_stack_change_callback(s,
-                                &p_tmp_node->focus_id,
-                                &tmp_next_focus_node->focus_id,
-                                callback_flag);
-                        }
-                    }
-                }
-                p_tmp_node->focus_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
-                app_focus_node_list_remove(s, p_tmp_node->focus_id.client_id);
-                s->cur_size -= 1;
-            }
-        }
+    if (app_focus_stack_is_empty(s)) {
+        return -ENOENT;
+    }
+
+    // node list is indexed by client id, no need to walk the stack
+    p_tmp_node = app_focus_node_list_find(s, value->client_id);
+    if (!p_tmp_node) {
+        return -ENOENT;
+    }
+
+    //  node need to be deleted at stack top
+    if (list_next(&s->head_node, &s->head_node) == &p_tmp_node->node) {
+        value->focus_callback = p_tmp_node->focus_id.focus_callback;
+        value->callback_argv = p_tmp_node->focus_id.callback_argv;
+        return app_focus_stack_pop(s, value, callback_flag);
     }
+
+    // node need to be deleted at stack under
+    p_tmp_node->focus_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
+    value->focus_callback = p_tmp_node->focus_id.focus_callback;
+    value->callback_argv = p_tmp_node->focus_id.callback_argv;
+    list_delete(&p_tmp_node->node);
+    app_focus_node_list_remove(s, p_tmp_node->focus_id.client_id);
+    s->cur_size -= 1;
+    return 0;
 }
 
 int app_focus_stack_top_change_broadcast(void* x, int callback_flag)
@@ -344,7 +401,7 @@ int app_focus_stack_top_change_broadcast(void* x, int callback_flag)
         struct app_focus_node,
         node)
     {
-        if (p_tmp_node->focus_id.focus_state == APP_FOCUS_STATE_STACK_TOP) {
+        if (list_next(&s->head_node, &s->head_node) == &p_tmp_node->node) {
             continue;
         } else {
             // listener: notify all focus under with focus top information
@@ -382,23 +439,15 @@ void app_focus_stack_clean(void* x, app_focus_id* value, int callback_flag)
 int app_focus_stack_search_client_id(void* x, app_focus_id* value)
 {
     app_focus_stack* s = (app_focus_stack*)x;
-    if (app_focus_stack_is_empty(s)) {
+    struct app_focus_node* p_tmp_node;
+
+    // node list is indexed by client id, no need to walk the stack
+    p_tmp_node = app_focus_node_list_find(s, value->client_id);
+    if (!p_tmp_node) {
         return -ENOENT;
-    } else {
-        struct app_focus_node* p_tmp_node;
-        int count = 0;
-        list_for_every_entry(&s->head_node,
-            p_tmp_node,
-            struct app_focus_node,
-            node)
-        {
-            if (p_tmp_node->focus_id.client_id == value->client_id) {
-                return count;
-            }
-            count += 1;
-        }
     }
-    return -ENOENT;
+    *value = p_tmp_node->focus_id;
+    return 0;
 }
 
 int app_focus_stack_search_focus_level(void* x, app_focus_id* value)
@@ -423,6 +472,25 @@ int app_focus_stack_search_focus_level(void* x, app_focus_id* value)
     return -ENOENT;
 }
 
+int app_focus_stack_search_callback(void* x, app_focus_id* value)
+{
+    app_focus_stack* s = (app_focus_stack*)x;
+    struct app_focus_node* p_tmp_node;
+
+    list_for_every_entry(&s->head_node,
+        p_tmp_node,
+        struct app_focus_node,
+        node)
+    {
+        if (p_tmp_node->focus_id.focus_callback == value->focus_callback
+            && p_tmp_node->focus_id.callback_argv == value->callback_argv) {
+            *value = p_tmp_node->focus_id;
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
 int app_focus_stack_get_index(void* x, app_focus_id* value, int index)
 {
     int count = 0;
@@ -473,39 +541,21 @@ void* app_focus_stack_init(size_t focus_stack_size,
     app_focus_change_callback focus_callback_method)
 {
     // pointer to app focus stack setting
-    app_focus_stack* s = malloc(sizeof(app_focus_stack));
+    app_focus_stack* s = zalloc(sizeof(app_focus_stack));
     if (!s) {
         auderr("No such mem for focus stack\n");
         return NULL;
     }
 
-    s->node_list = calloc(focus_stack_size, sizeof(app_focus_node));
-    if (!s->node_list) {
+    list_initialize(&s->head_node);
+    s->focus_change_callback = focus_callback_method;
+
+    if (app_focus_node_list_grow(s, focus_stack_size > 0 ? focus_stack_size : 1) < 0) {
         auderr("No such mem for stack node list\n");
-        free(s);
+        app_focus_stack_destory(s);
         return NULL;
     }
 
-    for (int i = 0; i < focus_stack_size; i++) {
-        app_focus_node tmp_node = {
-            LIST_INITIAL_VALUE(s->node_list->node),
-            {
-                .client_id = -1,
-                .focus_level = 0,
-                .thread_id = 0,
-                .focus_state = APP_FOCUS_STATE_STACK_QUIT,
-                .focus_callback = NULL,
-                .callback_argv = NULL,
-            }
-        };
-        *(s->node_list + i) = tmp_node;
-    }
-
-    list_initialize(&s->head_node);
-    s->cur_size = 0;
-    s->max_size = focus_stack_size;
-    s->focus_change_callback = focus_callback_method;
-
     return s;
 }
 
@@ -513,7 +563,11 @@ void app_focus_stack_destory(void* x)
 {
     app_focus_stack* s = (app_focus_stack*)x;
     if (s != NULL) {
+        for (int i = 0; i < s->max_size; i++) {
+            free(s->node_list[i]);
+        }
         free(s->node_list);
+        free(s->free_ids);
         free(s);
     }
 }
@@ -521,17 +575,10 @@ void app_focus_stack_destory(void* x)
 int app_focus_free_client_id(void* x)
 {
     app_focus_stack* s = (app_focus_stack*)x;
-    if (app_focus_stack_is_full(s)) {
+    if (s->free_size == 0 && app_focus_node_list_grow(s, 2 * s->max_size) < 0) {
         return -ENODATA;
     }
-    for (int i = 0; i < s->max_size; i++) {
-        if ((s->node_list + i)->focus_id.client_id == -1) {
-            return i;
-        } else {
-            continue;
-        }
-    }
-    return -ENODATA;
+    return s->free_ids[s->free_size - 1];
 }
 
 // return current app focus stack for checking
@@ -41,6 +41,7 @@ typedef struct app_focus_id {
     int focus_state;
     app_focus_callback focus_callback;
     void* callback_argv;
+    int suggestion; // last suggestion given to focus callback
 } app_focus_id;
 
 typedef void (*app_focus_change_callback)(
@@ -124,39 +125,41 @@ int app_focus_stack_push(void* x, app_focus_id* value, int callback_flag);
 int app_focus_stack_insert(void* x, app_focus_id* value, int index);
 
 /****************************************************************************
- * Name: app_focus_stack_delete
+ * Name: app_focus_stack_insert_level
  *
  * Description:
- *   This function delete app focus id in app focus stack with client id.
+ *   This function insert such app focus id under stack top, before first
+ *   app focus id with higher or same focus level, in a single walk.
  *
  * Input Parameters:
  *   x              - pointer of app focus stack
- *   value          - pointer of focus id, same client id will be deleted
- *   callback_flag  - flag for identify call back method status
+ *   value          - pointer of focus id, value will be insert into stack
  *
  * Returned Value:
- *   Return 0 if delete succeed, negative error number when failed.
+ *   Return 0 if insert succeed, negative error number when insert failed,
+ *   -ENOENT if stack top has higher or same focus level.
  *
  ****************************************************************************/
 
-int app_focus_stack_delete(void* x, app_focus_id* value, int callback_flag);
+int app_focus_stack_insert_level(void* x, app_focus_id* value);
 
 /****************************************************************************
- * Name: app_focus_stack_useless_clear
+ * Name: app_focus_stack_delete
  *
  * Description:
- *   This function clear useless app focus id in app focus stack.
+ *   This function delete app focus id in app focus stack with client id.
  *
  * Input Parameters:
  *   x              - pointer of app focus stack
+ *   value          - pointer of focus id, same client id will be deleted
  *   callback_flag  - flag for identify call back method status
  *
  * Returned Value:
- *   No return.
+ *   Return 0 if delete succeed, negative error number when failed.
  *
  ****************************************************************************/
 
-void app_focus_stack_useless_clear(void* x, int callback_flag);
+int app_focus_stack_delete(void* x, app_focus_id* value, int callback_flag);
 
 /****************************************************************************
  * Name: app_focus_stack_top_change_broadcast
@@ -227,6 +230,24 @@ int app_focus_stack_search_client_id(void* x, app_focus_id* value);
 
 int app_focus_stack_search_focus_level(void* x, app_focus_id* value);
 
+/****************************************************************************
+ * Name: app_focus_stack_search_callback
+ *
+ * Description:
+ *   This function search one app focus id in stack with same focus callback
+ *   and callback argv, to find focus id owned by such requester.
+ *
+ * Input Parameters:
+ *   x              - pointer of app focus stack
+ *   value          - pointer of focus id, which will catch searched result
+ *
+ * Returned Value:
+ *   Return 0 if search succeed, negative error number when failed.
+ *
+ ****************************************************************************/
+
+int app_focus_stack_search_callback(void* x, app_focus_id* value);
+
 /****************************************************************************
  * Name: app_focus_stack_get_index
  *
@@ -267,7 +288,8 @@ void app_focus_stack_display(void* x);
  *   This function initialize app stack setting when it created.
  *
  * Input Parameters:
- *   focus_stack_size       - focus stack size from xxx focus setting
+ *   focus_stack_size       - initial focus stack size from xxx focus
+ *                            setting, stack grows when it is full
  *   focus_callback_method  - xxx focus callback function
  *
  * Returned Value:
@@ -305,8 +327,9 @@ void app_focus_stack_destory(void* x);
  *   x    - pointer of app focus stack setting
  *
  * Returned Value:
- *   Return negative num when there is no free client for new request, 0 and
- *   other positive means free client id can be used in node list.
+ *   Return negative num when node list can not grow for new request, 0 and
+ *   other positive means free client id can be used in node list, it is
+ *   taken by next push or insert with such client id.
  *
  ****************************************************************************/
 
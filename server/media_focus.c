@@ -23,12 +23,16 @@
 #include <ctype.h>
 #include <debug.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "focus_stack.h"
 #include "media_common.h"
@@ -52,6 +56,10 @@
 #define MEDIA_FOCUS_FILE_READ_STREAM_TYPE 1
 #define MEDIA_FOCUS_FILE_READ_STREAM_NUM 2
 
+#define MEDIA_FOCUS_SNAPSHOT_MAGIC 0x5346434d /* "MCFS" */
+#define MEDIA_FOCUS_HASH_SEED_MAX 256
+
+#define ID_DETACHED 0x00000010
 #define ID_TO_HANDLE(x) (((x) << ID_SHIFT) | 0x0000000F)
 #define HANDLE_TO_ID(x) ((x) >> ID_SHIFT)
 
@@ -69,13 +77,37 @@ typedef struct media_focus_cell {
     int pas_inter;
 } media_focus_cell;
 
+typedef struct media_focus_change {
+    app_focus_id* id;
+    int suggestion;
+} media_focus_change;
+
 typedef struct media_focus {
     int num;
     void* stack;
+    media_focus_change* changes; /* suggestions of one stack change */
+    int nb_changes;
+    int max_changes;
     char* streams;
     media_focus_cell* matrix;
+    int* hash; /* perfect hash of streams, stream type to matrix level */
+    int hash_size;
+    uint32_t seed;
 } media_focus;
 
+/* Snapshot layout, read at once:
+ *  header, streams[num * STREAM_TYPE_LEN], matrix[num * num], hash[hash_size]
+ */
+
+typedef struct media_focus_snapshot {
+    uint32_t magic;
+    int32_t num;
+    int64_t size;
+    int64_t mtime;
+    uint32_t seed;
+    int32_t hash_size;
+} media_focus_snapshot;
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
@@ -285,6 +317,68 @@ static int media_focus_line_identity(char* line, int* shift_index)
     }
 }
 
+static uint32_t media_focus_hash(uint32_t seed, const char* str)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    while (*str) {
+        h ^= (uint8_t)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// find a seed mapping every stream type to its own hash slot
+static int media_focus_hash_init(media_focus* focus)
+{
+    int size, seed, i;
+    uint32_t h;
+
+    for (size = 2; size < 2 * focus->num; size <<= 1)
+        ;
+
+    for (; size <= 16 * focus->num; size <<= 1) {
+        int* hash = realloc(focus->hash, size * sizeof(int));
+        if (hash == NULL) {
+            MEDIA_ERR("no mem for media focus hash\n");
+            return -ENOMEM;
+        }
+        focus->hash = hash;
+        focus->hash_size = size;
+
+        for (seed = 0; seed < MEDIA_FOCUS_HASH_SEED_MAX; seed++) {
+            memset(hash, 0xff, size * sizeof(int));
+            for (i = 0; i < focus->num; i++) {
+                h = media_focus_hash(seed, focus->streams + i * STREAM_TYPE_LEN) & (size - 1);
+                if (hash[h] >= 0)
+                    break;
+                hash[h] = i;
+            }
+            if (i == focus->num) {
+                focus->seed = seed;
+                return 0;
+            }
+        }
+    }
+
+    MEDIA_ERR("no perfect hash for media focus streams\n");
+    return -EINVAL;
+}
+
+// give out matrix level of stream type, negative if unknown
+static int media_focus_stream_level(media_focus* focus, const char* stream_type)
+{
+    uint32_t h;
+    int level;
+
+    h = media_focus_hash(focus->seed, stream_type) & (focus->hash_size - 1);
+    level = focus->hash[h];
+    if (level < 0 || strcmp(focus->streams + level * STREAM_TYPE_LEN, stream_type))
+        return -EINVAL;
+
+    return level;
+}
+
 static int media_focus_play_arbitrate(app_focus_id* top_id, app_focus_id* cur_id)
 {
     int inter_location;
@@ -319,38 +413,92 @@ static int media_focus_play_arbitrate(app_focus_id* top_id, app_focus_id* cur_id
     return play_ret;
 }
 
-// callback method blocker for oper which does not needs instance callback
+void media_focus_notify_cb(int suggestion, void* cookie)
+{
+    media_stub_notify_event(cookie, suggestion, 0, NULL);
+}
+
+// callback method blocker for oper which does not needs instance callback,
+// suggestions are collected and sent by media_focus_flush_changes
 static void media_focus_stack_callback(
     app_focus_id* cur_id,
     app_focus_id* req_id,
     int callback_flag)
 {
+    media_focus_change* changes;
+    media_focus* focus;
+
     // step 1: use callback_flag block unnecessary calling
     if (callback_flag >= 0) {
         return;
     }
 
+    focus = media_get_focus();
+    if (focus == NULL || cur_id == NULL || req_id == NULL) {
+        return;
+    }
+
     // step 2: get focus return type of focus change listener
-    if (cur_id != NULL && req_id != NULL) {
-        req_id->focus_callback(media_focus_play_arbitrate(cur_id, req_id), req_id->callback_argv);
+    if (focus->nb_changes == focus->max_changes) {
+        changes = realloc(focus->changes,
+            (focus->max_changes + 8) * sizeof(media_focus_change));
+        if (changes == NULL) {
+            MEDIA_ERR("no mem for media focus changes\n");
+            return;
+        }
+        focus->changes = changes;
+        focus->max_changes += 8;
     }
+
+    // req_id is the node in stack, it stays valid until flushed
+    focus->changes[focus->nb_changes].id = req_id;
+    focus->changes[focus->nb_changes].suggestion = media_focus_play_arbitrate(cur_id, req_id);
+    focus->nb_changes++;
 }
 
-static int media_focus_focus_id_insert(void* x, app_focus_id* new_focus_id)
+// send collected suggestions in one pass, each suggestion is encoded once
+// for all client connections, suggestions same as last time are dropped
+static void media_focus_flush_changes(media_focus* focus)
 {
-    int index_value = 0;
-    app_focus_id focus_id;
-    while (!app_focus_stack_get_index(x, &focus_id, index_value)) {
-        if (new_focus_id->focus_level <= focus_id.focus_level) {
-            break;
+    media_parcel parcels[MEDIA_FOCUS_PLAY_WITH_KEEP + 1];
+    bool encoded[MEDIA_FOCUS_PLAY_WITH_KEEP + 1] = { false };
+    media_focus_change* change;
+    int i;
+
+    for (i = 0; i < focus->nb_changes; i++) {
+        change = &focus->changes[i];
+        if (change->id->suggestion == change->suggestion) {
+            continue;
+        }
+        change->id->suggestion = change->suggestion;
+
+        if (change->id->focus_callback != media_focus_notify_cb
+            || change->suggestion < 0 || change->suggestion > MEDIA_FOCUS_PLAY_WITH_KEEP) {
+            change->id->focus_callback(change->suggestion, change->id->callback_argv);
+            continue;
+        }
+
+        if (!encoded[change->suggestion]) {
+            media_parcel_init(&parcels[change->suggestion]);
+            media_parcel_append_printf(&parcels[change->suggestion], "%i%i%s",
+                change->suggestion, 0, NULL);
+            encoded[change->suggestion] = true;
         }
-        index_value += 1;
+        media_server_notify(media_get_server(), change->id->callback_argv,
+            &parcels[change->suggestion]);
     }
-    if (index_value < 0) {
-        MEDIA_ERR("no appro location for inserting new request\n");
-        return -ENODATA;
+
+    for (i = 0; i <= MEDIA_FOCUS_PLAY_WITH_KEEP; i++) {
+        if (encoded[i]) {
+            media_parcel_deinit(&parcels[i]);
+        }
     }
-    if (app_focus_stack_insert(x, new_focus_id, index_value) < 0) {
+    focus->nb_changes = 0;
+}
+
+static int media_focus_focus_id_insert(void* x, app_focus_id* new_focus_id)
+{
+    if (app_focus_stack_insert_level(x, new_focus_id) < 0) {
         MEDIA_ERR("inter media request failed\n");
         return -EINVAL;
     }
@@ -364,10 +512,9 @@ static void* media_focus_request_(
     media_focus_callback callback_method,
     void* callback_argv)
 {
-    int i;
     int ret = -EINVAL;
     int valid_id;
-    int new_stream_type = -EINVAL;
+    int new_stream_type;
     app_focus_id tmp_id;
     app_focus_id new_id;
 
@@ -384,43 +531,38 @@ static void* media_focus_request_(
     }
 
     // step 2: trans stream type to valid num in interaction matrix
-    for (i = 0; i < focus->num; i++) {
-        if (strcmp((focus->streams + i * STREAM_TYPE_LEN), stream_type) == 0) {
-            new_stream_type = i;
-            break;
-        }
-    }
+    new_stream_type = media_focus_stream_level(focus, stream_type);
     if (new_stream_type < 0) {
         MEDIA_ERR("wrong stream type input\n");
         goto err;
     }
 
-    // step 3: useless focus node clear
-    app_focus_stack_useless_clear(focus->stack, NONBLOCK_CALLBACK_FLAG);
-
-    // step 4: get valid id from focus stack
+    // step 3: get valid id from focus stack, stale ones are removed on
+    // disconnect, see media_focus_disconnect
     valid_id = app_focus_free_client_id(focus->stack);
     if (valid_id < 0) {
-        MEDIA_ERR("audio focus stack is full\n");
+        MEDIA_ERR("no mem for audio focus stack\n");
         goto err;
     }
 
-    // step 5: specific app_focus_request assemable
+    // step 4: specific app_focus_request assemable
     new_id.client_id = valid_id;
     new_id.focus_level = new_stream_type;
     new_id.thread_id = gettid();
     new_id.focus_state = APP_FOCUS_STATE_STACK_QUIT;
     new_id.focus_callback = callback_method;
     new_id.callback_argv = callback_argv;
+    new_id.suggestion = -1;
 
-    // step 6: get exist top focus id
+    // step 5: get exist top focus id
     if (app_focus_stack_top(focus->stack, &tmp_id) == 0) {
 
-        // step 7.1: compare with stack top
+        // step 6.1: compare with stack top
         int inter_location = new_id.focus_level * focus->num + tmp_id.focus_level;
         if (inter_location < (focus->num * focus->num)) {
             ret = (focus->matrix + inter_location)->pro_inter;
             *return_type = ret;
+            new_id.suggestion = ret;
             switch (ret) {
             case MEDIA_FOCUS_PLAY:
                 app_focus_stack_push(focus->stack, &new_id, BLOCK_CALLBACK_FLAG);
@@ -449,18 +591,21 @@ static void* media_focus_request_(
     } else {
         MEDIA_INFO("focus owner, id:%d, stream:%s level:%d\n",
             new_id.client_id, stream_type, new_id.focus_level);
-        // step 7.2: stack top not exist, request directly
+        // step 6.2: stack top not exist, request directly
         *return_type = MEDIA_FOCUS_PLAY;
         ret = MEDIA_FOCUS_PLAY;
+        new_id.suggestion = MEDIA_FOCUS_PLAY;
         app_focus_stack_push(focus->stack, &new_id, BLOCK_CALLBACK_FLAG);
     }
 
 err:
+    media_focus_flush_changes(focus);
     if (ret < 0) {
         return NULL;
     }
     if (*return_type == MEDIA_FOCUS_STOP) {
-        valid_id += CONFIG_MEDIA_FOCUS_STACK_DEPTH;
+        // not in stack, client id may be given to next request
+        return (void*)(uintptr_t)(ID_TO_HANDLE(valid_id) | ID_DETACHED);
     }
     return (void*)(uintptr_t)ID_TO_HANDLE(valid_id);
 }
@@ -476,12 +621,12 @@ static int media_focus_abandon_(media_focus* focus, void* handle)
         MEDIA_ERR("invalid app client id input\n");
         return -EINVAL;
     }
+    if (app_client_id & ID_DETACHED) {
+        return 0;
+    }
     app_client_id = HANDLE_TO_ID(app_client_id);
 
-    // step 2: useless focus id clear
-    app_focus_stack_useless_clear(focus->stack, NONBLOCK_CALLBACK_FLAG);
-
-    // step 3: get exist top focus id
+    // step 2: get exist top focus id
     if (app_focus_stack_top(focus->stack, &tmp_id) < 0) {
         MEDIA_ERR("media focus stack is empty\n");
         return -ENOENT;
@@ -492,39 +637,17 @@ static int media_focus_abandon_(media_focus* focus, void* handle)
         app_focus_stack_delete(focus->stack, &tmp_id, NONBLOCK_CALLBACK_FLAG);
         app_focus_stack_top_change_broadcast(focus->stack, NONBLOCK_CALLBACK_FLAG);
     } else {
-        // step 4: abandon focus id in media focus stack
+        // step 3: abandon focus id in media focus stack
         MEDIA_INFO("id:%d\n", app_client_id);
         tmp_id.client_id = app_client_id;
         app_focus_stack_delete(focus->stack, &tmp_id, NONBLOCK_CALLBACK_FLAG);
     }
 
+    media_focus_flush_changes(focus);
     return ret;
 }
 
-void media_focus_notify_cb(int suggestion, void* cookie)
-{
-    media_stub_notify_event(cookie, suggestion, 0, NULL);
-}
-
-/****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-int media_focus_destroy(void* handle)
-{
-    media_focus* focus = handle;
-
-    if (focus) {
-        free(focus->stack);
-        free(focus->streams);
-        free(focus->matrix);
-        free(focus);
-    }
-
-    return 0;
-}
-
-void* media_focus_create(void* file)
+static media_focus* media_focus_parse(const char* file)
 {
     FILE* fp;
     char* buf = NULL;
@@ -561,19 +684,12 @@ void* media_focus_create(void* file)
         switch (ret) {
         case MEDIA_FOCUS_FILE_READ_STREAM_TYPE:
 
-            // step 3.1: malloc space for stream types array based on number of stream type and fill with line read
+            // step 3: malloc space for stream types array based on number of stream type and fill with line read
             focus->streams = media_focus_streams_init(focus, STREAM_TYPE_LEN, line);
             if (!focus->streams) {
                 MEDIA_ERR("no mem for media focus streams\n");
                 goto err;
             }
-
-            // step 3.2 malloc space and init media stack
-            focus->stack = app_focus_stack_init(CONFIG_MEDIA_FOCUS_STACK_DEPTH, &media_focus_stack_callback);
-            if (!focus->stack) {
-                MEDIA_ERR("no mem for media focus stack\n");
-                goto err;
-            }
             break;
 
         case MEDIA_FOCUS_FILE_READ_STREAM_NUM:
@@ -591,6 +707,11 @@ void* media_focus_create(void* file)
         }
     }
 
+    if (!focus->streams || !focus->matrix) {
+        MEDIA_ERR("invalid interaction matrix file\n");
+        goto err;
+    }
+
     goto out;
 
 err:
@@ -602,6 +723,209 @@ out:
     return focus;
 }
 
+#ifdef CONFIG_MEDIA_FOCUS_SNAPSHOT
+
+static int media_focus_save_snapshot(media_focus* focus, const struct stat* st)
+{
+    const char* path = CONFIG_MEDIA_FOCUS_SNAPSHOT_PATH;
+    media_focus_snapshot header = { 0 };
+    char tmp[PATH_MAX];
+    size_t len;
+    int ret = 0;
+    int fd;
+
+    header.magic = MEDIA_FOCUS_SNAPSHOT_MAGIC;
+    header.num = focus->num;
+    header.size = st->st_size;
+    header.mtime = st->st_mtime;
+    header.seed = focus->seed;
+    header.hash_size = focus->hash_size;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -errno;
+
+    len = focus->num * STREAM_TYPE_LEN;
+    if (write(fd, &header, sizeof(header)) != sizeof(header)
+        || write(fd, focus->streams, len) != len)
+        ret = -EIO;
+
+    len = focus->num * focus->num * sizeof(media_focus_cell);
+    if (ret >= 0 && write(fd, focus->matrix, len) != len)
+        ret = -EIO;
+
+    len = focus->hash_size * sizeof(int);
+    if (ret >= 0 && write(fd, focus->hash, len) != len)
+        ret = -EIO;
+
+    close(fd);
+    if (ret >= 0 && rename(tmp, path) < 0)
+        ret = -errno;
+
+    if (ret < 0)
+        unlink(tmp);
+
+    return ret;
+}
+
+static media_focus* media_focus_load_snapshot(const struct stat* st)
+{
+    media_focus_snapshot* header;
+    media_focus* focus = NULL;
+    struct stat snap;
+    size_t len[3];
+    char* blob;
+    int fd;
+
+    fd = open(CONFIG_MEDIA_FOCUS_SNAPSHOT_PATH, O_RDONLY | O_BINARY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    blob = NULL;
+    if (fstat(fd, &snap) < 0 || snap.st_size < sizeof(*header))
+        goto out;
+
+    blob = malloc(snap.st_size);
+    if (blob == NULL || read(fd, blob, snap.st_size) != snap.st_size)
+        goto out;
+
+    header = (media_focus_snapshot*)blob;
+    len[0] = header->num * STREAM_TYPE_LEN;
+    len[1] = header->num * header->num * sizeof(media_focus_cell);
+    len[2] = header->hash_size * sizeof(int);
+    if (header->magic != MEDIA_FOCUS_SNAPSHOT_MAGIC
+        || header->size != st->st_size || header->mtime != st->st_mtime
+        || header->num <= 0 || header->hash_size <= 0
+        || snap.st_size != sizeof(*header) + len[0] + len[1] + len[2])
+        goto out;
+
+    focus = zalloc(sizeof(media_focus));
+    if (focus == NULL)
+        goto out;
+
+    focus->num = header->num;
+    focus->seed = header->seed;
+    focus->hash_size = header->hash_size;
+    focus->streams = malloc(len[0]);
+    focus->matrix = malloc(len[1]);
+    focus->hash = malloc(len[2]);
+    if (!focus->streams || !focus->matrix || !focus->hash) {
+        media_focus_destroy(focus);
+        focus = NULL;
+        goto out;
+    }
+
+    memcpy(focus->streams, blob + sizeof(*header), len[0]);
+    memcpy(focus->matrix, blob + sizeof(*header) + len[0], len[1]);
+    memcpy(focus->hash, blob + sizeof(*header) + len[0] + len[1], len[2]);
+
+out:
+    close(fd);
+    free(blob);
+    return focus;
+}
+
+#endif /* CONFIG_MEDIA_FOCUS_SNAPSHOT */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int media_focus_destroy(void* handle)
+{
+    media_focus* focus = handle;
+
+    if (focus) {
+        app_focus_stack_destory(focus->stack);
+        free(focus->streams);
+        free(focus->matrix);
+        free(focus->hash);
+        free(focus->changes);
+        free(focus);
+    }
+
+    return 0;
+}
+
+void* media_focus_create(void* file)
+{
+    media_focus* focus = NULL;
+#ifdef CONFIG_MEDIA_FOCUS_SNAPSHOT
+    struct stat st;
+
+    if (stat(file, &st) < 0) {
+        MEDIA_ERR("no such interaction matrix file\n");
+        return NULL;
+    }
+
+    focus = media_focus_load_snapshot(&st);
+#endif
+
+    if (!focus) {
+        focus = media_focus_parse(file);
+        if (!focus)
+            return NULL;
+
+        if (media_focus_hash_init(focus) < 0)
+            goto err;
+
+#ifdef CONFIG_MEDIA_FOCUS_SNAPSHOT
+        if (media_focus_save_snapshot(focus, &st) < 0)
+            MEDIA_WARN("save focus snapshot failed\n");
+#endif
+    }
+
+    // malloc space and init media stack
+    focus->stack = app_focus_stack_init(CONFIG_MEDIA_FOCUS_STACK_DEPTH, &media_focus_stack_callback);
+    if (!focus->stack) {
+        MEDIA_ERR("no mem for media focus stack\n");
+        goto err;
+    }
+
+    return focus;
+
+err:
+    media_focus_destroy(focus);
+    return NULL;
+}
+
+void* media_focus_acquire(void* focus, const char* scenario, int* suggestion,
+    media_focus_callback on_suggestion, void* cookie)
+{
+    if (!focus)
+        return NULL;
+
+    return media_focus_request_(focus, suggestion, scenario, on_suggestion, cookie);
+}
+
+int media_focus_release(void* focus, void* handle)
+{
+    if (!focus)
+        return -EINVAL;
+
+    return media_focus_abandon_(focus, handle);
+}
+
+void media_focus_disconnect(void* handle, void* cookie)
+{
+    media_focus* focus = handle;
+    app_focus_id tmp_id;
+
+    if (!focus || !cookie)
+        return;
+
+    // focus requested by this connection but never abandoned
+    tmp_id.focus_callback = media_focus_notify_cb;
+    tmp_id.callback_argv = cookie;
+    if (app_focus_stack_search_callback(focus->stack, &tmp_id) < 0)
+        return;
+
+    MEDIA_INFO("disconnected, id:%d\n", tmp_id.client_id);
+    media_focus_abandon_(focus, (void*)(uintptr_t)ID_TO_HANDLE(tmp_id.client_id));
+    media_stub_notify_finalize(&cookie);
+}
+
 void media_focus_debug_stack_display(void)
 {
     media_focus* focus;
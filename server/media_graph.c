@@ -25,19 +25,34 @@
 #include <nuttx/fs/fs.h>
 #include <nuttx/sched_note.h>
 
+#include <libavcodec/avcodec.h>
 #include <libavdevice/avdevice.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/filters.h>
 #include <libavfilter/internal.h>
 #include <libavfilter/movie_async.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
 #include <libavutil/opt.h>
+#include <libswresample/swresample.h>
 
 #include <assert.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <media_api.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#ifdef CONFIG_TIMER_FD
+#include <sys/timerfd.h>
+#endif
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "media_common.h"
@@ -47,8 +62,61 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
-#define MAX_GRAPH_SIZE 4096
 #define MAX_POLL_FILTERS 16
+#define MAX_POLLFDS CONFIG_MEDIA_SERVER_MAX_POLLFDS
+
+#ifndef CONFIG_MEDIA_GRAPH_MAX_SUBGRAPHS
+#define CONFIG_MEDIA_GRAPH_MAX_SUBGRAPHS 4
+#endif
+
+#ifndef CONFIG_MEDIA_GRAPH_THREAD_STACKSIZE
+#define CONFIG_MEDIA_GRAPH_THREAD_STACKSIZE 32768
+#endif
+
+#ifndef CONFIG_MEDIA_GRAPH_THREAD_PRIORITY
+#define CONFIG_MEDIA_GRAPH_THREAD_PRIORITY CONFIG_MEDIA_SERVER_PRIORITY
+#endif
+
+#ifndef CONFIG_MEDIA_GRAPH_STANDBY_FILTERS
+#define CONFIG_MEDIA_GRAPH_STANDBY_FILTERS 0
+#endif
+
+#ifndef CONFIG_MEDIA_STATUS_PLAYERS
+#define CONFIG_MEDIA_STATUS_PLAYERS 0
+#endif
+
+#ifndef CONFIG_MEDIA_SOUND_POOL_CLIPS
+#define CONFIG_MEDIA_SOUND_POOL_CLIPS 0
+#endif
+
+#ifndef CONFIG_MEDIA_SOUND_POOL_VOICES
+#define CONFIG_MEDIA_SOUND_POOL_VOICES 4
+#endif
+
+#ifndef CONFIG_MEDIA_SOUND_POOL_RATE
+#define CONFIG_MEDIA_SOUND_POOL_RATE 48000
+#endif
+
+#ifndef CONFIG_MEDIA_SOUND_POOL_CHANNELS
+#define CONFIG_MEDIA_SOUND_POOL_CHANNELS 2
+#endif
+
+#ifndef CONFIG_MEDIA_SOUND_POOL_CLIP_SIZE
+#define CONFIG_MEDIA_SOUND_POOL_CLIP_SIZE 262144
+#endif
+
+/* Independent subgraphs in graph.conf are separated by a "---" line. */
+
+#define MEDIA_SUBGRAPH_SEPARATOR "\n---\n"
+
+#define MEDIA_STATUS_SIZE (sizeof(media_status_page_t) \
+    + CONFIG_MEDIA_STATUS_PLAYERS * sizeof(media_status_record_t))
+
+/* Sound pool mixes voices in chunks, and waits that long for its input
+ * filter to connect to the data socket. */
+
+#define MEDIA_SOUND_CHUNK_FRAMES 256
+#define MEDIA_SOUND_ACCEPT_MS 1000
 
 #define MediaPlayerPriv MediaFilterPriv
 #define MediaRecorderPriv MediaFilterPriv
@@ -57,23 +125,122 @@
  * Private Types
  ****************************************************************************/
 
-typedef struct MediaGraphPriv {
+/* Each subgraph is scheduled by exactly one thread (`tid`): the first one
+ * by mediad main loop, the others by their own worker thread. Any other
+ * thread must hold `runlock` to touch the filters. Runlocks are ordered by
+ * `index`: a subgraph thread, which may hold its own runlock, never waits
+ * for the runlock of a lower subgraph, see media_graph_queue_command.
+ */
+
+typedef struct MediaSubgraphPriv {
     AVFilterGraph* graph;
     struct file* filep;
     int fd;
     pid_t tid;
+    int index;
+    pthread_t thread;
+    pthread_mutex_t runlock;
+    pthread_mutex_t cmdlock;
+    bool threaded;
+    bool quit;
     void* pollfts[MAX_POLL_FILTERS];
     int pollftn;
     struct MediaCommand* cmdhead;
     struct MediaCommand* cmdtail;
+} MediaSubgraphPriv;
+
+typedef struct MediaStatusOwner {
+    AVFilterContext* filter;
+    bool dirty;
+} MediaStatusOwner;
+
+typedef struct MediaGraphPriv {
+    MediaSubgraphPriv subgraphs[CONFIG_MEDIA_GRAPH_MAX_SUBGRAPHS];
+    int nb_subgraphs;
+    pthread_mutex_t postlock;
+    struct MediaEvent* posthead;
+    struct MediaEvent* posttail;
+    pthread_mutex_t progress_lock;
+    struct MediaFilterPriv* progress; /* Players pushing position events. */
+#if CONFIG_MEDIA_STATUS_PLAYERS > 0
+    pthread_mutex_t status_lock;
+    media_status_page_t* status;
+    MediaStatusOwner status_owners[CONFIG_MEDIA_STATUS_PLAYERS];
+    uint32_t status_id;
+#endif
+#if CONFIG_MEDIA_SOUND_POOL_CLIPS > 0
+    struct MediaSound* sounds; /* Decoded clips, shared by url. */
+    struct MediaSoundPool* pools;
+#endif
 } MediaGraphPriv;
 
+/* Filter event posted by its worker thread to mediad main loop. */
+
+typedef struct MediaEvent {
+    struct MediaFilterPriv* ctx;
+    int event;
+    int result;
+    unsigned gen;
+    char* extra;
+    struct MediaEvent* next;
+} MediaEvent;
+
 typedef struct MediaFilterPriv {
     AVFilterContext* filter;
+    struct MediaGraphPriv* graph;
+    char* stream;
     void* cookie;
+    void* focus;
+    bool player;
     bool event;
+    bool queued;
+    bool standby;
+    bool idle;
+    bool closing; /* Standby instance to recycle once playing is done. */
+    struct MediaFilterPriv* next;
+    /* `gen` changes on each open, under postlock. CLOSED is the last
+     * event of a ctx and can't fail to post, so it has its own node. */
+    unsigned gen;
+    MediaEvent closed;
+    /* Position events, in mediad main loop, valid if progress_ms is set. */
+    int progress_fd;
+    unsigned progress_ms;
+    bool progress_playing;
+    struct MediaFilterPriv* progress_next;
+    media_status_record_t* status;
+    struct MediaSoundPool* pool;
 } MediaFilterPriv;
 
+/* Sound pool is only touched by mediad main loop: clips are decoded once
+ * into interleaved s16 PCM, each pool plays them by id through one input
+ * filter, mixing its voices into that filter's data socket. */
+
+#if CONFIG_MEDIA_SOUND_POOL_CLIPS > 0
+typedef struct MediaSound {
+    char* url;
+    int16_t* pcm;
+    size_t samples;
+    int refs;
+    struct MediaSound* next;
+} MediaSound;
+
+typedef struct MediaSoundVoice {
+    MediaSound* sound;
+    size_t pos;
+} MediaSoundVoice;
+
+typedef struct MediaSoundPool {
+    struct MediaFilterPriv* ctx;
+    int fd;
+    MediaSound* clips[CONFIG_MEDIA_SOUND_POOL_CLIPS];
+    MediaSoundVoice voices[CONFIG_MEDIA_SOUND_POOL_VOICES];
+    int16_t buf[MEDIA_SOUND_CHUNK_FRAMES * CONFIG_MEDIA_SOUND_POOL_CHANNELS];
+    size_t off; /* Bytes of `buf` written, mix again once it reaches `len`. */
+    size_t len;
+    struct MediaSoundPool* next;
+} MediaSoundPool;
+#endif
+
 typedef struct MediaCommand {
     AVFilterContext* filter;
     char* cmd;
@@ -82,6 +249,14 @@ typedef struct MediaCommand {
     struct MediaCommand* next;
 } MediaCommand;
 
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int media_common_open(MediaGraphPriv* priv,
+    const char* arg, void* cookie, bool player, MediaFilterPriv** pctx);
+static void media_common_release(MediaFilterPriv* ctx);
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -120,7 +295,7 @@ static void media_trace_end(void* avcl, const char* fmt, va_list vl)
 
 static void media_graph_filter_ready(AVFilterContext* ctx)
 {
-    MediaGraphPriv* priv = ctx->graph->opaque;
+    MediaSubgraphPriv* priv = ctx->graph->opaque;
     eventfd_t val = 1;
 
     if (priv->tid != gettid())
@@ -156,91 +331,259 @@ static void media_graph_log_callback(void* avcl, int level,
     vsyslog(level, fmt, vl);
 }
 
-static int media_graph_load(MediaGraphPriv* priv, char* conf)
+static int media_subgraph_init(MediaSubgraphPriv* priv)
 {
-    char graph_desc[MAX_GRAPH_SIZE];
-    AVFilterInOut* input = NULL;
-    AVFilterInOut* output = NULL;
+    pthread_mutexattr_t attr;
     int ret;
-    int fd;
 
-    av_log_set_callback(media_graph_log_callback);
-#ifdef CONFIG_MEDIA_TRACE
-    av_trace_set_callback(media_trace_begin, media_trace_end);
-#endif
-    avdevice_register_all();
-
-    av_log(NULL, AV_LOG_INFO, "%s, loadgraph from file: %s\n", __func__, conf);
-
-    fd = open(conf, O_RDONLY | O_BINARY | O_CLOEXEC);
-    if (fd < 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s, can't open media graph file\n", __func__);
+    priv->fd = eventfd(0, EFD_CLOEXEC);
+    if (priv->fd < 0)
         return -errno;
+
+    ret = fs_getfilep(priv->fd, &priv->filep);
+    if (ret < 0) {
+        close(priv->fd);
+        return ret;
     }
 
-    ret = read(fd, graph_desc, MAX_GRAPH_SIZE);
-    close(fd);
-    if (ret < 0)
-        return -errno;
-    else if (ret == MAX_GRAPH_SIZE)
-        return -EFBIG;
+    /* Policy plugins may re-enter the graph from inside an event callback. */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&priv->runlock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&priv->cmdlock, NULL);
 
-    graph_desc[ret] = 0;
+    priv->tid = gettid();
+    priv->threaded = false;
+    priv->quit = false;
+    priv->cmdhead = NULL;
+    priv->cmdtail = NULL;
+    return 0;
+}
+
+static int media_subgraph_parse(MediaSubgraphPriv* priv, const char* desc)
+{
+    AVFilterInOut* input = NULL;
+    AVFilterInOut* output = NULL;
+    int ret;
 
     priv->graph = avfilter_graph_alloc();
     if (!priv->graph)
         return -ENOMEM;
 
-    ret = avfilter_graph_parse2(priv->graph, graph_desc, &input, &output);
+    ret = avfilter_graph_parse2(priv->graph, desc, &input, &output);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "%s, media graph parse error\n", __func__);
-        goto out;
+        return ret;
     }
 
     avfilter_inout_free(&input);
     avfilter_inout_free(&output);
+    return 0;
+}
+
+static int media_subgraph_config(MediaSubgraphPriv* priv)
+{
+    int ret, i;
 
     ret = avfilter_graph_config(priv->graph, NULL);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "%s, media graph config error\n", __func__);
-        goto out;
+        return ret;
     }
 
     priv->graph->ready = media_graph_filter_ready;
     priv->graph->opaque = priv;
 
     priv->pollftn = 0;
-    for (fd = 0; fd < priv->graph->nb_filters; fd++) {
-        AVFilterContext* filter = priv->graph->filters[fd];
+    for (i = 0; i < priv->graph->nb_filters; i++) {
+        AVFilterContext* filter = priv->graph->filters[i];
 
         if ((filter->filter->flags & AVFILTER_FLAG_SUPPORT_POLL) != 0) {
-            priv->pollfts[priv->pollftn++] = filter;
-            if (priv->pollftn > MAX_POLL_FILTERS) {
+            if (priv->pollftn >= MAX_POLL_FILTERS) {
                 av_log(NULL, AV_LOG_ERROR, "%s, media graph too many pollfds\n", __func__);
-                goto out;
+                return -E2BIG;
             }
+
+            priv->pollfts[priv->pollftn++] = filter;
         }
     }
 
-    av_log(NULL, AV_LOG_INFO, "%s, loadgraph succeed\n", __func__);
     return 0;
+}
+
+static int media_graph_add_subgraph(MediaGraphPriv* priv,
+    MediaSubgraphPriv** psub)
+{
+    int ret;
+
+    if (priv->nb_subgraphs >= CONFIG_MEDIA_GRAPH_MAX_SUBGRAPHS) {
+        av_log(NULL, AV_LOG_ERROR, "%s, media graph too many subgraphs\n", __func__);
+        return -E2BIG;
+    }
+
+    ret = media_subgraph_init(&priv->subgraphs[priv->nb_subgraphs]);
+    if (ret < 0)
+        return ret;
+
+    priv->subgraphs[priv->nb_subgraphs].index = priv->nb_subgraphs;
+
+    *psub = &priv->subgraphs[priv->nb_subgraphs++];
+    return 0;
+}
+
+static int media_graph_load(MediaGraphPriv* priv, char* conf)
+{
+    MediaSubgraphPriv* sub;
+    char *graph_desc, *desc, *next;
+    struct stat st;
+    int ret, fd;
+
+    av_log_set_callback(media_graph_log_callback);
+#ifdef CONFIG_MEDIA_TRACE
+    av_trace_set_callback(media_trace_begin, media_trace_end);
+#endif
+    avdevice_register_all();
+
+    av_log(NULL, AV_LOG_INFO, "%s, loadgraph from file: %s\n", __func__, conf);
+
+    fd = open(conf, O_RDONLY | O_BINARY | O_CLOEXEC);
+    if (fd < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s, can't open media graph file\n", __func__);
+        return -errno;
+    }
+
+    /* Sized from the file, graph.conf has no length limit. */
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    graph_desc = malloc(st.st_size + 1);
+    if (!graph_desc) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    ret = read(fd, graph_desc, st.st_size);
+    close(fd);
+    if (ret < 0) {
+        ret = -errno;
+        goto out;
+    }
+
+    graph_desc[ret] = 0;
+
+    for (desc = graph_desc; desc; desc = next) {
+        next = strstr(desc, MEDIA_SUBGRAPH_SEPARATOR);
+        if (next) {
+            *next = '\0';
+            next += strlen(MEDIA_SUBGRAPH_SEPARATOR);
+        }
+
+        if (desc[strspn(desc, " \t\r\n")] == '\0')
+            continue;
+
+        ret = media_graph_add_subgraph(priv, &sub);
+        if (ret < 0)
+            goto out;
+
+        ret = media_subgraph_parse(sub, desc);
+        if (ret < 0)
+            goto out;
+
+        ret = media_subgraph_config(sub);
+        if (ret < 0)
+            goto out;
+    }
+
+    if (priv->nb_subgraphs == 0) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    av_log(NULL, AV_LOG_INFO, "%s, loadgraph succeed, %d subgraph(s)\n",
+        __func__, priv->nb_subgraphs);
+    ret = 0;
+
 out:
-    avfilter_graph_free(&priv->graph);
+    free(graph_desc);
+    return ret;
+}
+
+static int media_graph_process_command(AVFilterContext* filter,
+    const char* cmd, const char* arg, char* res, int res_len, int flags)
+{
+    MediaSubgraphPriv* priv = filter->graph->opaque;
+    int ret;
+
+    pthread_mutex_lock(&priv->runlock);
+    ret = avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+    pthread_mutex_unlock(&priv->runlock);
     return ret;
 }
 
-static int media_graph_queue_command(MediaGraphPriv* priv, AVFilterContext* filter,
+/* Target is either the full filter name, or the part after '@'. */
+
+static bool media_graph_match_filter(AVFilterContext* filter, const char* target)
+{
+    const char* tmp;
+
+    if (!strcmp(target, filter->name))
+        return true;
+
+    tmp = strchr(filter->name, '@');
+    return tmp && !strncmp(tmp + 1, target, strlen(target));
+}
+
+/* Whether `priv` is lower than the subgraph current thread schedules. */
+
+static bool media_subgraph_is_lower(MediaSubgraphPriv* priv)
+{
+    MediaSubgraphPriv* subgraphs = priv - priv->index;
+    pid_t tid = gettid();
+    int i;
+
+    for (i = priv->index + 1; i < CONFIG_MEDIA_GRAPH_MAX_SUBGRAPHS; i++) {
+        if (subgraphs[i].threaded && subgraphs[i].tid == tid)
+            return true;
+    }
+
+    return false;
+}
+
+static int media_graph_queue_command(AVFilterContext* filter,
     const char* cmd, const char* arg, char* res, int res_len, int flags)
 {
+    MediaSubgraphPriv* priv = filter->graph->opaque;
+    bool owner = priv->tid == gettid();
+    eventfd_t val = 1;
     MediaCommand* tmp;
+    bool direct;
+    int ret;
 
-    if (res && res_len > 0)
-        return avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+    if (res && res_len > 0) {
+        if (!media_subgraph_is_lower(priv))
+            return media_graph_process_command(filter, cmd, arg, res, res_len, flags);
 
-    if (!priv->cmdhead && !ff_filter_graph_has_pending_status(filter->graph)) {
+        /* Against lock order, don't wait or the two threads may deadlock. */
+        if (pthread_mutex_trylock(&priv->runlock))
+            return -EBUSY;
+
+        ret = avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+        pthread_mutex_unlock(&priv->runlock);
+        return ret;
+    }
+
+    pthread_mutex_lock(&priv->cmdlock);
+    direct = owner && !priv->cmdhead && !ff_filter_graph_has_pending_status(filter->graph);
+    pthread_mutex_unlock(&priv->cmdlock);
+
+    if (direct) {
         av_log(NULL, AV_LOG_INFO, "process %s %s %s\n",
             filter->name, cmd, arg ? arg : "_");
-        return avfilter_process_command(filter, cmd, arg, NULL, 0, flags);
+        return media_graph_process_command(filter, cmd, arg, NULL, 0, flags);
     }
 
     tmp = malloc(sizeof(MediaCommand));
@@ -262,12 +605,19 @@ static int media_graph_queue_command(MediaGraphPriv* priv, AVFilterContext* filt
     tmp->flags = flags;
     tmp->next = NULL;
 
+    pthread_mutex_lock(&priv->cmdlock);
     if (!priv->cmdhead)
         priv->cmdhead = tmp;
     else
         priv->cmdtail->next = tmp;
 
     priv->cmdtail = tmp;
+    pthread_mutex_unlock(&priv->cmdlock);
+
+    /* Kick the thread owning this subgraph to run the command. */
+    if (!owner)
+        file_write(priv->filep, &val, sizeof(eventfd_t));
+
     av_log(NULL, AV_LOG_INFO, "pending %s %s %s\n",
         filter->name, cmd, arg ? arg : "_");
     return 0;
@@ -279,29 +629,31 @@ err1:
     return -ENOMEM;
 }
 
-static int media_graph_dequeue_command(MediaGraphPriv* priv, bool process)
+static int media_graph_dequeue_command(MediaSubgraphPriv* priv, bool process)
 {
     MediaCommand* tmp;
     int ret = 0;
 
+    pthread_mutex_lock(&priv->cmdlock);
     tmp = priv->cmdhead;
-    if (!tmp)
+    if (!tmp || (process && ff_filter_graph_has_pending_status(priv->graph))) {
+        pthread_mutex_unlock(&priv->cmdlock);
         return -EAGAIN;
+    }
 
-    if (process) {
-        if (ff_filter_graph_has_pending_status(priv->graph))
-            return -EAGAIN;
+    priv->cmdhead = tmp->next;
+    if (!priv->cmdhead)
+        priv->cmdtail = NULL;
 
+    pthread_mutex_unlock(&priv->cmdlock);
+
+    if (process) {
         av_log(NULL, AV_LOG_INFO, "process %s %s %s\n",
             tmp->filter->name, tmp->cmd, tmp->arg ? tmp->arg : "_");
         ret = avfilter_process_command(tmp->filter, tmp->cmd, tmp->arg,
             NULL, 0, tmp->flags);
     }
 
-    priv->cmdhead = tmp->next;
-    if (!priv->cmdhead)
-        priv->cmdtail = NULL;
-
     av_free(tmp->cmd);
     av_free(tmp->arg);
     av_free(tmp);
@@ -309,121 +661,1480 @@ static int media_graph_dequeue_command(MediaGraphPriv* priv, bool process)
     return ret;
 }
 
-static int media_find_filter(MediaGraphPriv* priv, const char* prefix,
-    bool input, bool available, AVFilterContext** pfilter)
+static int media_subgraph_get_pollfds(MediaSubgraphPriv* priv,
+    struct pollfd* fds, void** cookies, int count)
 {
-    AVFilterContext* filter = NULL;
-    char name[64];
-    int i, j, ret;
+    int ret, nfd, i;
 
-    // policy might do mapping (e.g. "Music" => "amovie_async@Music")
-    ret = media_stub_get_stream_name(prefix, name, sizeof(name));
+    if (!fds || count < 2)
+        return -EINVAL;
 
-    for (i = 0; i < priv->graph->nb_filters; i++) {
-        filter = priv->graph->filters[i];
-
-        if (!available || !filter->opaque) {
-            if (!prefix) {
-                // find an available input/output as prefix is not specified.
-                if (input) {
-                    for (j = 0; g_media_inputs[j]; j++)
-                        if (!strcmp(filter->filter->name, g_media_inputs[j])) {
-                            *pfilter = filter;
-                            return 0;
-                        }
-                } else {
-                    for (j = 0; g_media_outputs[j]; j++)
-                        if (!strcmp(filter->filter->name, g_media_outputs[j])) {
-                            *pfilter = filter;
-                            return 0;
-                        }
-                }
-            } else {
-                if (ret == 0)
-                    prefix = name;
-
-                if (!strncmp(filter->name, prefix, strlen(prefix))) {
-                    *pfilter = filter;
-                    return 0;
-                }
-            }
+    fds[0].fd = priv->fd;
+    fds[0].events = POLLIN;
+    cookies[0] = NULL;
+    nfd = 1;
+
+    for (i = 0; i < priv->pollftn; i++) {
+        AVFilterContext* filter = priv->pollfts[i];
+
+        ret = media_graph_process_command(filter, "get_pollfd", NULL,
+            (char*)&fds[nfd], sizeof(struct pollfd) * (count - nfd),
+            AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0)
+            continue;
+
+        while (ret--) {
+            cookies[nfd++] = filter;
+            if (nfd > count)
+                return -EINVAL;
         }
     }
 
-    *pfilter = NULL;
-    if (ret == 0) /* filter found in policy but not available. */
-        return -EINVAL;
-    return -ENOTSUP;
+    return nfd;
 }
 
-static void media_common_notify_cb(void* cookie, int event,
-    int result, const char* extra)
+static int media_subgraph_poll_available(MediaSubgraphPriv* priv,
+    struct pollfd* fd, void* cookie)
 {
-    MediaFilterPriv* ctx = cookie;
+    eventfd_t unuse;
 
-    if (ctx->event)
-        media_stub_notify_event(ctx->cookie, event, result, extra);
+    if (!fd)
+        return -EINVAL;
+
+    if (cookie)
+        media_graph_process_command(cookie, "poll_available", NULL,
+            (char*)fd, sizeof(struct pollfd), AV_OPT_SEARCH_CHILDREN);
+    else
+        eventfd_read(priv->fd, &unuse);
+
+    return 0;
 }
 
-static void media_common_event_cb(void* cookie, int event,
-    int result, const char* extra)
+static int media_subgraph_run_once(MediaSubgraphPriv* priv)
 {
-    MediaFilterPriv* ctx = cookie;
+    int ret;
 
-    switch (event) {
-    case AVMOVIE_ASYNC_EVENT_STARTED:
-        if (result == 0)
-            media_stub_set_stream_status(ctx->filter->name, true);
-        break;
+    pthread_mutex_lock(&priv->runlock);
 
-    case AVMOVIE_ASYNC_EVENT_PAUSED:
-    case AVMOVIE_ASYNC_EVENT_STOPPED:
-    case AVMOVIE_ASYNC_EVENT_COMPLETED:
-        media_stub_set_stream_status(ctx->filter->name, false);
+    ret = ff_filter_graph_run_all(priv->graph);
+    if (ret < 0)
+        goto out;
+
+    do {
+        ret = media_graph_dequeue_command(priv, true);
+    } while (ret >= 0);
+
+    if (ret == -EAGAIN)
+        ret = 0;
+
+out:
+    pthread_mutex_unlock(&priv->runlock);
+    return ret;
+}
+
+static void* media_subgraph_thread(void* arg)
+{
+    MediaSubgraphPriv* priv = arg;
+    struct pollfd fds[MAX_POLLFDS];
+    void* cookies[MAX_POLLFDS];
+    int ret, n, i;
+
+    priv->tid = gettid();
+
+    while (!priv->quit) {
+        n = media_subgraph_get_pollfds(priv, fds, cookies, MAX_POLLFDS);
+        if (n < 0) {
+            MEDIA_ERR("subgraph get_pollfds failed %d\n", n);
+            break;
+        }
+
+        poll(fds, n, -1);
+
+        for (i = 0; i < n; i++) {
+            if (fds[i].revents)
+                media_subgraph_poll_available(priv, &fds[i], cookies[i]);
+        }
+
+        ret = media_subgraph_run_once(priv);
+        if (ret < 0)
+            MEDIA_ERR("subgraph run_once failed %d\n", ret);
+    }
+
+    return NULL;
+}
+
+static int media_subgraph_start(MediaSubgraphPriv* priv, int index)
+{
+    struct sched_param param;
+    pthread_attr_t attr;
+    char name[32];
+    int ret;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, CONFIG_MEDIA_GRAPH_THREAD_STACKSIZE);
+    param.sched_priority = CONFIG_MEDIA_GRAPH_THREAD_PRIORITY;
+    pthread_attr_setschedparam(&attr, &param);
+
+    /* Hand over before the thread exists: until it takes `tid`, no thread
+     * owns the subgraph, commands are queued or run under runlock. */
+    priv->tid = INVALID_PROCESS_ID;
+    priv->threaded = true;
+
+    ret = -pthread_create(&priv->thread, &attr, media_subgraph_thread, priv);
+    pthread_attr_destroy(&attr);
+    if (ret < 0) {
+        priv->threaded = false;
+        priv->tid = gettid();
+        return ret;
+    }
+
+    snprintf(name, sizeof(name), "media_graph%d", index);
+    pthread_setname_np(priv->thread, name);
+    return 0;
+}
+
+static void media_subgraph_destroy(MediaSubgraphPriv* priv)
+{
+    eventfd_t val = 1;
+    int ret;
+
+    if (priv->threaded) {
+        priv->quit = true;
+        file_write(priv->filep, &val, sizeof(eventfd_t));
+        pthread_join(priv->thread, NULL);
+    }
+
+    do {
+        ret = media_graph_dequeue_command(priv, false);
+    } while (ret >= 0);
+
+    avfilter_graph_free(&priv->graph);
+    pthread_mutex_destroy(&priv->cmdlock);
+    pthread_mutex_destroy(&priv->runlock);
+    close(priv->fd);
+}
+
+static bool media_filter_match(AVFilterContext* filter,
+    const char* prefix, bool input)
+{
+    const char** names = input ? g_media_inputs : g_media_outputs;
+    int j;
+
+    // find an available input/output as prefix is not specified.
+    if (!prefix) {
+        for (j = 0; names[j]; j++)
+            if (!strcmp(filter->filter->name, names[j]))
+                return true;
+
+        return false;
+    }
+
+    return !strncmp(filter->name, prefix, strlen(prefix));
+}
+
+static int media_find_filter(MediaGraphPriv* priv, const char* prefix,
+    bool input, bool available, AVFilterContext** pfilter)
+{
+    AVFilterContext* filter = NULL;
+    AVFilterGraph* graph;
+    char name[64];
+    int i, k, ret;
+
+    // policy might do mapping (e.g. "Music" => "amovie_async@Music")
+    ret = media_stub_get_stream_name(prefix, name, sizeof(name));
+    if (ret == 0 && prefix)
+        prefix = name;
+
+    for (k = 0; k < priv->nb_subgraphs; k++) {
+        graph = priv->subgraphs[k].graph;
+
+        for (i = 0; i < graph->nb_filters; i++) {
+            filter = graph->filters[i];
+
+            /* Standby instance is taken only while idle. */
+            if (available && filter->opaque
+                && !((MediaFilterPriv*)filter->opaque)->idle)
+                continue;
+
+            if (media_filter_match(filter, prefix, input)) {
+                *pfilter = filter;
+                return 0;
+            }
+        }
+    }
+
+    *pfilter = NULL;
+    if (ret == 0) /* filter found in policy but not available. */
+        return -EINVAL;
+    return -ENOTSUP;
+}
+
+static void media_common_notify_cb(void* cookie, int event,
+    int result, const char* extra)
+{
+    MediaFilterPriv* ctx = cookie;
+
+    if (ctx->event)
+        media_stub_notify_event(ctx->cookie, event, result, extra);
+}
+
+static int media_player_query_one(AVFilterContext* filter, const char* cmd,
+    long* value)
+{
+    char tmp[32];
+    int ret;
+
+    ret = media_graph_queue_command(filter, cmd, NULL,
+        tmp, sizeof(tmp), AV_OPT_SEARCH_CHILDREN);
+    if (ret >= 0)
+        *value = strtol(tmp, NULL, 0);
+
+    return ret;
+}
+
+/* Players might be closed by their worker thread, while mediad main loop
+ * polls their timers, so progress list is only touched with lock held. */
+
+#ifdef CONFIG_TIMER_FD
+static MediaFilterPriv* media_progress_find(MediaGraphPriv* priv, void* cookie)
+{
+    MediaFilterPriv* ctx;
+
+    for (ctx = priv->progress; ctx; ctx = ctx->progress_next) {
+        if (ctx == cookie)
+            break;
+    }
+
+    return ctx;
+}
+
+/* Push current position at once, then every interval if playing. */
+static void media_progress_arm(MediaFilterPriv* ctx, bool playing)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    if (playing) {
+        its.it_interval.tv_sec = ctx->progress_ms / 1000;
+        its.it_interval.tv_nsec = (ctx->progress_ms % 1000) * 1000000;
+    }
+
+    ctx->progress_playing = playing;
+    timerfd_settime(ctx->progress_fd, 0, &its, NULL);
+}
+
+static int media_progress_start(MediaFilterPriv* ctx, unsigned ms)
+{
+    MediaGraphPriv* priv = ctx->graph;
+    eventfd_t val = 1;
+    int fd;
+
+    pthread_mutex_lock(&priv->progress_lock);
+
+    if (!ctx->progress_ms) {
+        fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+            pthread_mutex_unlock(&priv->progress_lock);
+            return -errno;
+        }
+
+        ctx->progress_fd = fd;
+        ctx->progress_next = priv->progress;
+        priv->progress = ctx;
+    }
+
+    ctx->progress_ms = ms;
+    pthread_mutex_unlock(&priv->progress_lock);
+
+    /* Wake up main loop to poll the new timer. */
+    file_write(priv->subgraphs[0].filep, &val, sizeof(eventfd_t));
+    return 0;
+}
+
+static void media_progress_stop(MediaFilterPriv* ctx)
+{
+    MediaGraphPriv* priv = ctx->graph;
+    MediaFilterPriv** pctx;
+
+    pthread_mutex_lock(&priv->progress_lock);
+
+    if (ctx->progress_ms) {
+        for (pctx = &priv->progress; *pctx != ctx; pctx = &(*pctx)->progress_next)
+            ;
+
+        *pctx = ctx->progress_next;
+        close(ctx->progress_fd);
+        ctx->progress_ms = 0;
+    }
+
+    pthread_mutex_unlock(&priv->progress_lock);
+}
+
+static void media_progress_update(MediaFilterPriv* ctx, int event, int result)
+{
+    MediaGraphPriv* priv = ctx->graph;
+
+    pthread_mutex_lock(&priv->progress_lock);
+
+    if (ctx->progress_ms) {
+        if (event == MEDIA_EVENT_STARTED && result == 0)
+            media_progress_arm(ctx, true);
+        else if (event == MEDIA_EVENT_SEEKED)
+            media_progress_arm(ctx, ctx->progress_playing);
+        else if (event == MEDIA_EVENT_PAUSED || event == MEDIA_EVENT_STOPPED
+            || event == MEDIA_EVENT_COMPLETED)
+            media_progress_arm(ctx, false);
+    }
+
+    pthread_mutex_unlock(&priv->progress_lock);
+}
+
+static int media_progress_set(MediaFilterPriv* ctx, const char* arg)
+{
+    unsigned ms = arg ? strtoul(arg, NULL, 0) : 0;
+    char tmp[32];
+    int ret;
+
+    if (!ms) {
+        media_progress_stop(ctx);
+        return 0;
+    }
+
+    ret = media_progress_start(ctx, ms);
+    if (ret < 0)
+        return ret;
+
+    ret = media_graph_queue_command(ctx->filter, "get_playing", NULL,
+        tmp, sizeof(tmp), AV_OPT_SEARCH_CHILDREN);
+
+    pthread_mutex_lock(&ctx->graph->progress_lock);
+    if (ctx->progress_ms)
+        media_progress_arm(ctx, ret >= 0 && atoi(tmp) > 0);
+    pthread_mutex_unlock(&ctx->graph->progress_lock);
+    return 0;
+}
+
+static int media_progress_get_pollfds(MediaGraphPriv* priv,
+    struct pollfd* fds, void** cookies, int count)
+{
+    MediaFilterPriv* ctx;
+    int nfd = 0;
+
+    pthread_mutex_lock(&priv->progress_lock);
+
+    for (ctx = priv->progress; ctx && nfd < count; ctx = ctx->progress_next) {
+        fds[nfd].fd = ctx->progress_fd;
+        fds[nfd].events = POLLIN;
+        cookies[nfd++] = ctx;
+    }
+
+    pthread_mutex_unlock(&priv->progress_lock);
+    return nfd;
+}
+
+/* Return false if cookie is not a player in progress list. */
+static bool media_progress_available(MediaGraphPriv* priv, void* cookie)
+{
+    AVFilterContext* filter = NULL;
+    struct timespec ts;
+    MediaFilterPriv* ctx;
+    bool playing = false;
+    uint64_t expired;
+    char tmp[64];
+    int ret;
+
+    pthread_mutex_lock(&priv->progress_lock);
+
+    ctx = media_progress_find(priv, cookie);
+    if (ctx) {
+        read(ctx->progress_fd, &expired, sizeof(expired));
+        filter = ctx->filter;
+        playing = ctx->progress_playing;
+    }
+
+    pthread_mutex_unlock(&priv->progress_lock);
+
+    if (!filter)
+        return false;
+
+    /* Filter lives as long as graph, so query it without lock. */
+    ret = media_graph_queue_command(filter, "get_position", NULL,
+        tmp, sizeof(tmp), AV_OPT_SEARCH_CHILDREN);
+    if (ret < 0)
+        return true;
+
+    /* fmt: position(ms):monotonic timestamp(ms):rate(permille) */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    snprintf(tmp, sizeof(tmp), "%lu:%" PRIu64 ":%d", strtoul(tmp, NULL, 0),
+        (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000, playing ? 1000 : 0);
+
+    pthread_mutex_lock(&priv->progress_lock);
+    ctx = media_progress_find(priv, cookie);
+    if (ctx)
+        media_common_notify_cb(ctx, MEDIA_EVENT_POSITION, 0, tmp);
+    pthread_mutex_unlock(&priv->progress_lock);
+    return true;
+}
+#else
+#define media_progress_start(ctx, ms) (-ENOSYS)
+#define media_progress_stop(ctx)
+#define media_progress_update(ctx, event, result)
+#define media_progress_set(ctx, arg) (-ENOSYS)
+#define media_progress_get_pollfds(priv, fds, cookies, count) 0
+#define media_progress_available(priv, cookie) false
+#endif
+
+/* Status records are written under status_lock by mediad main loop (state
+ * on events, open, close and position refresh), criteria by the policy on
+ * change, `seq` lets clients read them without any lock. */
+
+#if CONFIG_MEDIA_STATUS_PLAYERS > 0
+static void media_status_create(MediaGraphPriv* priv)
+{
+    media_status_page_t* page;
+    int fd;
+
+    pthread_mutex_init(&priv->status_lock, NULL);
+
+    fd = shm_open(MEDIA_STATUS_NAME, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+        goto err;
+
+    if (ftruncate(fd, MEDIA_STATUS_SIZE) < 0) {
+        close(fd);
+        goto err;
+    }
+
+    page = mmap(NULL, MEDIA_STATUS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED)
+        goto err;
+
+    memset(page, 0, MEDIA_STATUS_SIZE);
+    page->nb = CONFIG_MEDIA_STATUS_PLAYERS;
+    atomic_thread_fence(memory_order_release);
+    page->magic = MEDIA_STATUS_MAGIC;
+    priv->status = page;
+    return;
+
+err:
+    MEDIA_WARN("status page unavailable: %d\n", errno);
+}
+
+static void media_status_destroy(MediaGraphPriv* priv)
+{
+    if (priv->status) {
+        munmap(priv->status, MEDIA_STATUS_SIZE);
+        shm_unlink(MEDIA_STATUS_NAME);
+    }
+
+    pthread_mutex_destroy(&priv->status_lock);
+}
+
+static void media_status_begin(atomic_uint* seq)
+{
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void media_status_end(atomic_uint* seq)
+{
+    atomic_fetch_add_explicit(seq, 1, memory_order_release);
+}
+
+static void media_status_open(MediaFilterPriv* ctx)
+{
+    MediaGraphPriv* priv = ctx->graph;
+    media_status_record_t* record;
+    int i;
+
+    if (!priv->status || ctx->status)
+        return;
+
+    pthread_mutex_lock(&priv->status_lock);
+
+    for (i = 0; i < priv->status->nb; i++) {
+        record = &priv->status->records[i];
+        if (record->data.id)
+            continue;
+
+        if (++priv->status_id == 0)
+            priv->status_id = 1;
+
+        media_status_begin(&record->seq);
+        memset(&record->data, 0, sizeof(record->data));
+        record->data.id = priv->status_id;
+        record->data.state = MEDIA_EVENT_STOPPED;
+        record->data.volume = -1;
+        strlcpy(record->data.stream, ctx->stream ? ctx->stream : ctx->filter->name,
+            sizeof(record->data.stream));
+        media_status_end(&record->seq);
+
+        priv->status_owners[i].filter = ctx->filter;
+        priv->status_owners[i].dirty = false;
+        ctx->status = record;
+        break;
+    }
+
+    pthread_mutex_unlock(&priv->status_lock);
+}
+
+static void media_status_close(MediaFilterPriv* ctx)
+{
+    MediaGraphPriv* priv = ctx->graph;
+    media_status_record_t* record;
+
+    if (!priv->status)
+        return;
+
+    pthread_mutex_lock(&priv->status_lock);
+
+    record = ctx->status;
+    if (record) {
+        media_status_begin(&record->seq);
+        memset(&record->data, 0, sizeof(record->data));
+        media_status_end(&record->seq);
+
+        priv->status_owners[record - priv->status->records].filter = NULL;
+        ctx->status = NULL;
+    }
+
+    pthread_mutex_unlock(&priv->status_lock);
+}
+
+/* Called on filter events, position is refreshed after them in main loop. */
+static void media_status_update(MediaFilterPriv* ctx, int event, int result)
+{
+    MediaGraphPriv* priv = ctx->graph;
+    media_status_record_t* record;
+
+    if (!priv->status || result < 0)
+        return;
+
+    switch (event) {
+    case MEDIA_EVENT_PREPARED:
+    case MEDIA_EVENT_STARTED:
+    case MEDIA_EVENT_PAUSED:
+    case MEDIA_EVENT_STOPPED:
+    case MEDIA_EVENT_COMPLETED:
+    case MEDIA_EVENT_SEEKED:
+    case MEDIA_EVENT_SWITCHED:
+        break;
+
+    default:
+        return;
+    }
+
+    pthread_mutex_lock(&priv->status_lock);
+
+    record = ctx->status;
+    if (record) {
+        /* Position jumps but state stays, just refresh. */
+        if (event != MEDIA_EVENT_SEEKED && event != MEDIA_EVENT_SWITCHED) {
+            media_status_begin(&record->seq);
+            record->data.state = event;
+            media_status_end(&record->seq);
+        }
+
+        priv->status_owners[record - priv->status->records].dirty = true;
+    }
+
+    pthread_mutex_unlock(&priv->status_lock);
+}
+
+static void media_status_refresh(MediaGraphPriv* priv)
+{
+    char stream[MEDIA_STATUS_STREAM_LEN];
+    long position = 0, duration = 0;
+    media_status_record_t* record;
+    AVFilterContext* filter;
+    struct timespec ts;
+    int i, volume;
+    uint32_t id;
+
+    if (!priv->status)
+        return;
+
+    for (i = 0; i < priv->status->nb; i++) {
+        record = &priv->status->records[i];
+
+        pthread_mutex_lock(&priv->status_lock);
+        filter = priv->status_owners[i].dirty ? priv->status_owners[i].filter : NULL;
+        priv->status_owners[i].dirty = false;
+        id = record->data.id;
+        strlcpy(stream, record->data.stream, sizeof(stream));
+        pthread_mutex_unlock(&priv->status_lock);
+
+        if (!filter)
+            continue;
+
+        /* Query without lock, worker thread might be waiting for it. */
+        if (media_player_query_one(filter, "get_position", &position) < 0)
+            position = 0;
+
+        if (media_player_query_one(filter, "get_duration", &duration) < 0)
+            duration = 0;
+
+        if (media_stub_get_stream_volume(stream, &volume) < 0)
+            volume = -1;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        pthread_mutex_lock(&priv->status_lock);
+        if (record->data.id == id) {
+            media_status_begin(&record->seq);
+            record->data.position = position;
+            record->data.duration = duration;
+            record->data.volume = volume;
+            record->data.timestamp = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+            media_status_end(&record->seq);
+        }
+
+        pthread_mutex_unlock(&priv->status_lock);
+    }
+}
+
+/* Called wherever the policy changes the criterion, worker threads
+ * included. A slot is kept by its name once taken. */
+static int media_status_set_criterion(MediaGraphPriv* priv, const char* name,
+    int number, const char* literal)
+{
+    media_status_criterion_t* criterion = NULL;
+    int i;
+
+    if (!priv->status)
+        return -ENOENT;
+
+    pthread_mutex_lock(&priv->status_lock);
+
+    for (i = 0; i < MEDIA_STATUS_CRITERIA; i++) {
+        criterion = &priv->status->criteria[i];
+        if (!criterion->data.name[0] || !strcmp(criterion->data.name, name))
+            break;
+    }
+
+    if (i < MEDIA_STATUS_CRITERIA) {
+        media_status_begin(&criterion->seq);
+        strlcpy(criterion->data.name, name, sizeof(criterion->data.name));
+        criterion->data.number = number;
+        strlcpy(criterion->data.literal, literal ? literal : "",
+            sizeof(criterion->data.literal));
+        media_status_end(&criterion->seq);
+    }
+
+    pthread_mutex_unlock(&priv->status_lock);
+    return i < MEDIA_STATUS_CRITERIA ? 0 : -ENOSPC;
+}
+#else
+#define media_status_create(priv)
+#define media_status_destroy(priv)
+#define media_status_open(ctx)
+#define media_status_close(ctx)
+#define media_status_update(ctx, event, result)
+#define media_status_refresh(priv)
+#define media_status_set_criterion(priv, name, number, literal) -ENOSYS
+#endif
+
+/* Sound pool: "load_sound" decodes a clip on mediad main loop, so clips
+ * should be short, "play_sound" only starts a voice. The pool's input
+ * filter reads raw PCM from a socket mediad listens on, like the data
+ * socket of a buffer mode player. */
+
+#if CONFIG_MEDIA_SOUND_POOL_CLIPS > 0
+static int media_sound_append(MediaSound* sound, SwrContext* swr, AVFrame* frame)
+{
+    int in = frame ? frame->nb_samples : 0;
+    uint8_t* out;
+    int16_t* pcm;
+    size_t size;
+    int max, ret;
+
+    max = swr_get_out_samples(swr, in);
+    if (max <= 0)
+        return max;
+
+    size = (sound->samples + (size_t)max * CONFIG_MEDIA_SOUND_POOL_CHANNELS) * sizeof(int16_t);
+    if (size > CONFIG_MEDIA_SOUND_POOL_CLIP_SIZE)
+        return -E2BIG;
+
+    pcm = realloc(sound->pcm, size);
+    if (!pcm)
+        return -ENOMEM;
+
+    sound->pcm = pcm;
+    out = (uint8_t*)(pcm + sound->samples);
+    ret = swr_convert(swr, &out, max,
+        frame ? (const uint8_t**)frame->extended_data : NULL, in);
+    if (ret < 0)
+        return ret;
+
+    sound->samples += (size_t)ret * CONFIG_MEDIA_SOUND_POOL_CHANNELS;
+    return 0;
+}
+
+static int media_sound_decode(MediaSound* sound)
+{
+    AVFormatContext* fmt = NULL;
+    AVCodecContext* dec = NULL;
+    SwrContext* swr = NULL;
+    AVPacket* pkt = NULL;
+    AVFrame* frame = NULL;
+    AVChannelLayout layout;
+    const AVCodec* codec;
+    int ret, index;
+
+    ret = avformat_open_input(&fmt, sound->url, NULL, NULL);
+    if (ret < 0)
+        return ret;
+
+    ret = avformat_find_stream_info(fmt, NULL);
+    if (ret < 0)
+        goto out;
+
+    index = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    if (index < 0) {
+        ret = index;
+        goto out;
+    }
+
+    dec = avcodec_alloc_context3(codec);
+    pkt = av_packet_alloc();
+    frame = av_frame_alloc();
+    if (!dec || !pkt || !frame) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    ret = avcodec_parameters_to_context(dec, fmt->streams[index]->codecpar);
+    if (ret >= 0)
+        ret = avcodec_open2(dec, codec, NULL);
+    if (ret < 0)
+        goto out;
+
+    av_channel_layout_default(&layout, CONFIG_MEDIA_SOUND_POOL_CHANNELS);
+    ret = swr_alloc_set_opts2(&swr, &layout, AV_SAMPLE_FMT_S16, CONFIG_MEDIA_SOUND_POOL_RATE,
+        &dec->ch_layout, dec->sample_fmt, dec->sample_rate, 0, NULL);
+    if (ret >= 0)
+        ret = swr_init(swr);
+    if (ret < 0)
+        goto out;
+
+    for (;;) {
+        /* End of file or read error ends the clip, NULL drains decoder. */
+        ret = av_read_frame(fmt, pkt);
+        if (ret >= 0 && pkt->stream_index != index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        ret = avcodec_send_packet(dec, ret >= 0 ? pkt : NULL);
+        av_packet_unref(pkt);
+        if (ret < 0)
+            goto out;
+
+        while ((ret = avcodec_receive_frame(dec, frame)) >= 0) {
+            ret = media_sound_append(sound, swr, frame);
+            av_frame_unref(frame);
+            if (ret < 0)
+                goto out;
+        }
+
+        if (ret == AVERROR_EOF)
+            break;
+
+        if (ret != AVERROR(EAGAIN))
+            goto out;
+    }
+
+    /* Flush samples delayed by resampler. */
+    ret = media_sound_append(sound, swr, NULL);
+
+out:
+    swr_free(&swr);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&dec);
+    avformat_close_input(&fmt);
+    return ret;
+}
+
+static int media_sound_load(MediaGraphPriv* priv, const char* url, MediaSound** psound)
+{
+    MediaSound* sound;
+    int ret = -ENOMEM;
+
+    for (sound = priv->sounds; sound; sound = sound->next)
+        if (!strcmp(sound->url, url))
+            goto out;
+
+    sound = zalloc(sizeof(MediaSound));
+    if (!sound)
+        return ret;
+
+    sound->url = strdup(url);
+    if (sound->url)
+        ret = media_sound_decode(sound);
+
+    if (ret < 0 || !sound->samples) {
+        MEDIA_WARN("sound %s decode failed %d\n", url, ret);
+        free(sound->pcm);
+        free(sound->url);
+        free(sound);
+        return ret < 0 ? ret : -EINVAL;
+    }
+
+    sound->next = priv->sounds;
+    priv->sounds = sound;
+
+out:
+    sound->refs++;
+    *psound = sound;
+    return 0;
+}
+
+static void media_sound_unref(MediaGraphPriv* priv, MediaSound* sound)
+{
+    MediaSound** p;
+
+    if (--sound->refs > 0)
+        return;
+
+    for (p = &priv->sounds; *p != sound; p = &(*p)->next)
+        ;
+
+    *p = sound->next;
+    free(sound->pcm);
+    free(sound->url);
+    free(sound);
+}
+
+/* Mix next chunk of all voices into `buf`, false if none is playing. */
+static bool media_sound_mix(MediaSoundPool* pool)
+{
+    const size_t chunk = sizeof(pool->buf) / sizeof(pool->buf[0]);
+    MediaSoundVoice* voice;
+    size_t i, j, n, len = 0;
+    int32_t sample;
+
+    memset(pool->buf, 0, sizeof(pool->buf));
+
+    for (i = 0; i < CONFIG_MEDIA_SOUND_POOL_VOICES; i++) {
+        voice = &pool->voices[i];
+        if (!voice->sound)
+            continue;
+
+        n = voice->sound->samples - voice->pos;
+        if (n > chunk)
+            n = chunk;
+
+        for (j = 0; j < n; j++) {
+            sample = pool->buf[j] + voice->sound->pcm[voice->pos + j];
+            if (sample > INT16_MAX)
+                sample = INT16_MAX;
+            else if (sample < INT16_MIN)
+                sample = INT16_MIN;
+
+            pool->buf[j] = sample;
+        }
+
+        voice->pos += n;
+        if (voice->pos >= voice->sound->samples)
+            voice->sound = NULL;
+
+        if (len < n)
+            len = n;
+    }
+
+    pool->off = 0;
+    pool->len = len * sizeof(int16_t);
+    return len > 0;
+}
+
+/* Write till the socket is full, main loop polls it for the rest. */
+static void media_sound_feed(MediaSoundPool* pool)
+{
+    ssize_t ret;
+
+    while (pool->off < pool->len || media_sound_mix(pool)) {
+        ret = write(pool->fd, (uint8_t*)pool->buf + pool->off, pool->len - pool->off);
+        if (ret < 0) {
+            if (errno == EAGAIN)
+                return;
+
+            MEDIA_WARN("sound pool %p write failed %d\n", pool, errno);
+            memset(pool->voices, 0, sizeof(pool->voices));
+            pool->off = pool->len = 0;
+            return;
+        }
+
+        pool->off += ret;
+    }
+}
+
+static bool media_sound_busy(MediaSoundPool* pool)
+{
+    int i;
+
+    if (pool->off < pool->len)
+        return true;
+
+    for (i = 0; i < CONFIG_MEDIA_SOUND_POOL_VOICES; i++)
+        if (pool->voices[i].sound)
+            return true;
+
+    return false;
+}
+
+static int media_sound_open(MediaFilterPriv* ctx)
+{
+    char tmp[UNIX_PATH_MAX + 32];
+    struct sockaddr_un addr;
+    MediaSoundPool* pool;
+    struct pollfd pfd;
+    int fd, ret;
+
+    if (ctx->pool)
+        return 0;
+
+    pool = zalloc(sizeof(MediaSoundPool));
+    if (!pool)
+        return -ENOMEM;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, UNIX_PATH_MAX, MEDIA_GRAPH_SOCKADDR_NAME, pool);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ret = -errno;
+        goto err;
+    }
+
+    if (bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(fd, 1) < 0) {
+        ret = -errno;
+        goto err;
+    }
+
+    snprintf(tmp, sizeof(tmp), "format=s16le:sample_rate=%d:ch_layout=%s",
+        CONFIG_MEDIA_SOUND_POOL_RATE, CONFIG_MEDIA_SOUND_POOL_CHANNELS == 1 ? "mono" : "stereo");
+    ret = media_graph_queue_command(ctx->filter, "set_options", tmp,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    if (ret < 0)
+        goto err;
+
+    snprintf(tmp, sizeof(tmp), "unix:%s?listen=0", addr.sun_path);
+    ret = media_graph_queue_command(ctx->filter, "prepare", tmp,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    if (ret < 0)
+        goto err;
+
+    /* Filter connects from its worker thread, don't wait forever. */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, MEDIA_SOUND_ACCEPT_MS);
+    if (ret <= 0) {
+        ret = ret < 0 ? -errno : -ETIMEDOUT;
+        goto err_reset;
+    }
+
+    pool->fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (pool->fd < 0) {
+        ret = -errno;
+        goto err_reset;
+    }
+
+    close(fd);
+    fd = -1;
+
+    /* Input stays started, it just waits for data while no voice plays. */
+    ret = media_graph_queue_command(ctx->filter, "start", NULL,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    if (ret < 0) {
+        close(pool->fd);
+        goto err_reset;
+    }
+
+    pool->ctx = ctx;
+    pool->next = ctx->graph->pools;
+    ctx->graph->pools = pool;
+    ctx->pool = pool;
+    return 0;
+
+err_reset:
+    media_graph_queue_command(ctx->filter, "reset", NULL,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+err:
+    if (fd >= 0)
+        close(fd);
+
+    free(pool);
+    return ret;
+}
+
+static void media_sound_close(MediaFilterPriv* ctx)
+{
+    MediaSoundPool* pool = ctx->pool;
+    MediaSoundPool** p;
+    int i;
+
+    if (!pool)
+        return;
+
+    for (p = &ctx->graph->pools; *p != pool; p = &(*p)->next)
+        ;
+
+    *p = pool->next;
+
+    for (i = 0; i < CONFIG_MEDIA_SOUND_POOL_CLIPS; i++)
+        if (pool->clips[i])
+            media_sound_unref(ctx->graph, pool->clips[i]);
+
+    /* Input filter reads end of file and completes. */
+    close(pool->fd);
+    free(pool);
+    ctx->pool = NULL;
+}
+
+static void media_sound_destroy(MediaGraphPriv* priv)
+{
+    while (priv->pools)
+        media_sound_close(priv->pools->ctx);
+}
+
+static int media_sound_handler(MediaFilterPriv* ctx, const char* cmd, const char* arg)
+{
+    MediaSoundVoice *voice = NULL, *tmp;
+    MediaSoundPool* pool;
+    MediaSound* sound;
+    int i, id, ret;
+
+    if (!strcmp(cmd, "load_sound")) {
+        if (!arg)
+            return -EINVAL;
+
+        ret = media_sound_open(ctx);
+        if (ret < 0)
+            return ret;
+
+        pool = ctx->pool;
+        for (id = 0; id < CONFIG_MEDIA_SOUND_POOL_CLIPS; id++)
+            if (!pool->clips[id])
+                break;
+
+        if (id == CONFIG_MEDIA_SOUND_POOL_CLIPS)
+            return -ENOSPC;
+
+        ret = media_sound_load(ctx->graph, arg, &pool->clips[id]);
+        return ret < 0 ? ret : id;
+    }
+
+    /* Others take the clip id. */
+    pool = ctx->pool;
+    id = arg ? atoi(arg) : -1;
+    if (!pool || id < 0 || id >= CONFIG_MEDIA_SOUND_POOL_CLIPS || !pool->clips[id])
+        return -EINVAL;
+
+    sound = pool->clips[id];
+
+    if (!strcmp(cmd, "play_sound")) {
+        /* Take a free voice, or cut the one played the longest. */
+        for (i = 0; i < CONFIG_MEDIA_SOUND_POOL_VOICES; i++) {
+            tmp = &pool->voices[i];
+            if (!tmp->sound) {
+                voice = tmp;
+                break;
+            }
+
+            if (!voice || tmp->pos > voice->pos)
+                voice = tmp;
+        }
+
+        voice->sound = sound;
+        voice->pos = 0;
+        media_sound_feed(pool);
+        return 0;
+    }
+
+    /* unload_sound */
+    for (i = 0; i < CONFIG_MEDIA_SOUND_POOL_VOICES; i++)
+        if (pool->voices[i].sound == sound)
+            pool->voices[i].sound = NULL;
+
+    pool->clips[id] = NULL;
+    media_sound_unref(ctx->graph, sound);
+    return 0;
+}
+
+static int media_sound_get_pollfds(MediaGraphPriv* priv,
+    struct pollfd* fds, void** cookies, int count)
+{
+    MediaSoundPool* pool;
+    int nfd = 0;
+
+    for (pool = priv->pools; pool && nfd < count; pool = pool->next) {
+        if (!media_sound_busy(pool))
+            continue;
+
+        fds[nfd].fd = pool->fd;
+        fds[nfd].events = POLLOUT;
+        cookies[nfd++] = pool;
+    }
+
+    return nfd;
+}
+
+/* Return false if cookie is not a sound pool. */
+static bool media_sound_available(MediaGraphPriv* priv, void* cookie)
+{
+    MediaSoundPool* pool;
+
+    for (pool = priv->pools; pool; pool = pool->next) {
+        if (pool == cookie) {
+            media_sound_feed(pool);
+            return true;
+        }
+    }
+
+    return false;
+}
+#else
+#define media_sound_close(ctx)
+#define media_sound_destroy(priv)
+#define media_sound_handler(ctx, cmd, arg) (-ENOSYS)
+#define media_sound_get_pollfds(priv, fds, cookies, count) 0
+#define media_sound_available(priv, cookie) false
+#endif
+
+static void media_common_abandon_focus(MediaFilterPriv* ctx)
+{
+    void* focus = ctx->focus;
+
+    if (focus) {
+        ctx->focus = NULL;
+        media_stub_abandon_focus(focus);
+    }
+}
+
+static int media_common_suggest(MediaFilterPriv* ctx, int suggestion)
+{
+    const char* volume = NULL;
+    const char* cmd = "start";
+
+    switch (suggestion) {
+    case MEDIA_FOCUS_PLAY:
+        volume = "1.0";
+        break;
+
+    case MEDIA_FOCUS_PLAY_BUT_SILENT:
+        volume = "0.0";
+        break;
+
+    case MEDIA_FOCUS_PLAY_WITH_DUCK:
+        volume = "0.1";
+        break;
+
+    case MEDIA_FOCUS_STOP:
+        cmd = "stop";
+        break;
+
+    case MEDIA_FOCUS_PAUSE:
+        cmd = "pause";
+        break;
+
+    default:
+        return 0;
+    }
+
+    /* Recorder only follows start/stop/pause. */
+    if (volume && ctx->player)
+        media_graph_queue_command(ctx->filter, "volume", volume,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+
+    return media_graph_queue_command(ctx->filter, cmd, NULL,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+}
+
+static void media_common_focus_cb(int suggestion, void* cookie)
+{
+    /* Focus belongs to the connection, follow its current source. Don't
+     * abandon here: focus stack is walking its nodes to broadcast. */
+    MediaFilterPriv* ctx = media_server_get_data(cookie);
+
+    if (ctx && ctx->focus)
+        media_common_suggest(ctx, suggestion);
+}
+
+static int media_common_start_auto(MediaFilterPriv* ctx, const char* scenario)
+{
+    int suggestion = MEDIA_FOCUS_STOP;
+
+    if (!scenario || !scenario[0])
+        return -EINVAL;
+
+    if (ctx->focus) {
+        MEDIA_WARN("%s force start\n", ctx->filter->name);
+        return media_graph_queue_command(ctx->filter, "start", NULL,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    }
+
+    /* Request focus and apply suggestion in mediad, no client round trip. */
+    ctx->focus = media_stub_request_focus(scenario, &suggestion,
+        media_common_focus_cb, ctx->cookie);
+    if (!ctx->focus)
+        return -EPERM;
+
+    switch (suggestion) {
+    case MEDIA_FOCUS_PLAY:
+    case MEDIA_FOCUS_PLAY_BUT_SILENT:
+    case MEDIA_FOCUS_PLAY_WITH_DUCK:
+        return media_common_suggest(ctx, suggestion);
+
+    case MEDIA_FOCUS_STOP:
+        media_common_abandon_focus(ctx);
+        media_common_suggest(ctx, suggestion);
+        break;
+
+    case MEDIA_FOCUS_PAUSE:
+        media_common_suggest(ctx, suggestion);
+        break;
+    }
+
+    return -EPERM;
+}
+
+static int media_common_open_next(MediaFilterPriv* ctx)
+{
+    if (ctx->next)
+        return 0;
+
+    /* Next source must go to an input of the same stream. */
+    if (!ctx->stream)
+        return -EINVAL;
+
+    ctx->queued = false;
+    return media_common_open(ctx->graph, ctx->stream, NULL, true, &ctx->next);
+}
+
+static void media_common_close_next(MediaFilterPriv* ctx)
+{
+    MediaFilterPriv* next = ctx->next;
+
+    if (!next)
+        return;
+
+    ctx->next = NULL;
+    ctx->queued = false;
+    media_common_release(next);
+}
+
+static void media_common_switch_next(MediaFilterPriv* ctx)
+{
+    MediaFilterPriv* next = ctx->next;
+    unsigned progress = ctx->progress_ms;
+
+    /* Hand over the client connection to the queued source. */
+    media_progress_stop(ctx);
+    if (progress && media_progress_start(next, progress) < 0)
+        MEDIA_WARN("%p keep progress failed\n", next);
+
+    ctx->next = NULL;
+    ctx->queued = false;
+    next->cookie = ctx->cookie;
+    next->focus = ctx->focus;
+    next->event = ctx->event;
+    ctx->cookie = NULL;
+    ctx->focus = NULL;
+    ctx->event = false;
+    media_server_set_data(next->cookie, next);
+
+    /* Start right in the completion of current source, no client round trip. */
+    media_common_notify_cb(next, MEDIA_EVENT_SWITCHED, 0, NULL);
+    media_graph_queue_command(next->filter, "start", NULL,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    media_common_release(ctx);
+}
+
+/* Focus stack, policy and client connections belong to mediad main loop,
+ * so worker threads only post their events, in order, to be run there. */
+static void media_common_post(MediaFilterPriv* ctx, int event,
+    int result, const char* extra)
+{
+    MediaGraphPriv* priv = ctx->graph;
+    eventfd_t val = 1;
+    MediaEvent* evt;
+
+    if (event == AVMOVIE_ASYNC_EVENT_CLOSED)
+        evt = &ctx->closed;
+    else {
+        evt = malloc(sizeof(MediaEvent) + (extra ? strlen(extra) + 1 : 0));
+        if (!evt) {
+            MEDIA_ERR("%s drop event %d\n", ctx->filter->name, event);
+            return;
+        }
+    }
+
+    evt->ctx = ctx;
+    evt->event = event;
+    evt->result = result;
+    evt->extra = NULL;
+    evt->next = NULL;
+    if (extra && evt != &ctx->closed) {
+        evt->extra = (char*)(evt + 1);
+        strcpy(evt->extra, extra);
+    }
+
+    pthread_mutex_lock(&priv->postlock);
+
+    evt->gen = ctx->gen;
+    if (priv->posttail)
+        priv->posttail->next = evt;
+    else
+        priv->posthead = evt;
+
+    priv->posttail = evt;
+    pthread_mutex_unlock(&priv->postlock);
+
+    file_write(priv->subgraphs[0].filep, &val, sizeof(eventfd_t));
+}
+
+static void media_common_closed(MediaFilterPriv* ctx)
+{
+    media_stub_notify_finalize(&ctx->cookie);
+    media_common_abandon_focus(ctx);
+    media_common_close_next(ctx);
+    media_progress_stop(ctx);
+    media_status_close(ctx);
+    ctx->filter->opaque = NULL;
+    free(ctx->stream);
+    free(ctx);
+}
+
+static void media_common_completed(MediaFilterPriv* ctx)
+{
+    if (ctx->closing) {
+        media_common_notify_cb(ctx, MEDIA_EVENT_COMPLETED, 0, NULL);
+        media_stub_notify_finalize(&ctx->cookie);
+        media_common_release(ctx);
+        return;
+    }
+
+    if (ctx->queued) {
+        media_common_switch_next(ctx);
+        return;
+    }
+
+    media_common_abandon_focus(ctx);
+    media_progress_update(ctx, MEDIA_EVENT_COMPLETED, 0);
+    media_status_update(ctx, MEDIA_EVENT_COMPLETED, 0);
+    media_common_notify_cb(ctx, MEDIA_EVENT_COMPLETED, 0, NULL);
+}
+
+static void media_common_event(MediaFilterPriv* ctx, int event,
+    int result, const char* extra, bool stale)
+{
+    switch (event) {
+    case AVMOVIE_ASYNC_EVENT_STARTED:
+        if (result == 0)
+            media_stub_set_stream_status(ctx->filter->name, true);
+        break;
+
+    case AVMOVIE_ASYNC_EVENT_COMPLETED:
+        media_stub_set_stream_status(ctx->filter->name, false);
+        if (!stale)
+            media_common_completed(ctx);
+        return;
+
+    case AVMOVIE_ASYNC_EVENT_PAUSED:
+    case AVMOVIE_ASYNC_EVENT_STOPPED:
+        media_stub_set_stream_status(ctx->filter->name, false);
         break;
 
     case AVMOVIE_ASYNC_EVENT_CLOSED:
         media_stub_set_stream_status(ctx->filter->name, false);
-        media_stub_notify_finalize(&ctx->cookie);
-        ctx->filter->opaque = NULL;
-        free(ctx);
+        media_common_closed(ctx);
         return;
     }
 
+    /* Instance reopened meanwhile, the event is not its own. */
+    if (stale)
+        return;
+
+    media_progress_update(ctx, event, result);
+    media_status_update(ctx, event, result);
     media_common_notify_cb(ctx, event, result, extra);
+
+    if (ctx->closing && (event == AVMOVIE_ASYNC_EVENT_PAUSED
+            || event == AVMOVIE_ASYNC_EVENT_STOPPED)) {
+        media_stub_notify_finalize(&ctx->cookie);
+        media_common_release(ctx);
+    }
 }
 
-static int media_common_open(MediaGraphPriv* priv,
-    const char* arg, void* cookie, bool player, MediaFilterPriv** pctx)
+static void media_common_run_posted(MediaGraphPriv* priv)
+{
+    MediaEvent* evt;
+    bool stale;
+
+    for (; ; ) {
+        pthread_mutex_lock(&priv->postlock);
+
+        evt = priv->posthead;
+        if (evt) {
+            priv->posthead = evt->next;
+            if (!priv->posthead)
+                priv->posttail = NULL;
+
+            stale = evt->gen != evt->ctx->gen;
+        }
+
+        pthread_mutex_unlock(&priv->postlock);
+
+        if (!evt)
+            break;
+
+        /* CLOSED node lives in ctx, which is freed by the event. */
+        media_common_event(evt->ctx, evt->event, evt->result, evt->extra, stale);
+        if (evt->event != AVMOVIE_ASYNC_EVENT_CLOSED)
+            free(evt);
+    }
+}
+
+static void media_common_event_cb(void* cookie, int event,
+    int result, const char* extra)
+{
+    media_common_post(cookie, event, result, extra);
+}
+
+static int media_common_launch(MediaGraphPriv* priv,
+    AVFilterContext* filter, MediaFilterPriv** pctx)
 {
     AVMovieAsyncEventCookie event;
     MediaFilterPriv* ctx;
     int ret;
 
-    *pctx = NULL;
     ctx = zalloc(sizeof(MediaFilterPriv));
     if (!ctx)
         return -ENOMEM;
 
-    ret = media_find_filter(priv, arg, player, true, &ctx->filter);
-    if (ret < 0)
-        goto err;
+    ctx->filter = filter;
 
     /* Launch filter worker thread. */
-    ret = avfilter_process_command(ctx->filter, "open", NULL, NULL, 0, 0);
+    ret = media_graph_process_command(ctx->filter, "open", NULL, NULL, 0, 0);
     if (ret < 0)
         goto err;
 
     event.cookie = ctx;
     event.event = media_common_event_cb;
 
-    ret = avfilter_process_command(ctx->filter, "set_event", (const char*)&event, NULL, 0, 0);
+    ret = media_graph_process_command(ctx->filter, "set_event", (const char*)&event, NULL, 0, 0);
     if (ret < 0) {
-        avfilter_process_command(ctx->filter, "close", NULL, NULL, 0, 0);
+        media_graph_process_command(ctx->filter, "close", NULL, NULL, 0, 0);
         goto err;
     }
 
-    ctx->cookie = cookie;
+    ctx->graph = priv;
     ctx->filter->opaque = ctx;
     *pctx = ctx;
     return 0;
@@ -433,6 +2144,160 @@ err:
     return ret;
 }
 
+static int media_common_open(MediaGraphPriv* priv,
+    const char* arg, void* cookie, bool player, MediaFilterPriv** pctx)
+{
+    AVFilterContext* filter;
+    MediaFilterPriv* ctx;
+    char* stream = NULL;
+    int ret;
+
+    *pctx = NULL;
+    ret = media_find_filter(priv, arg, player, true, &filter);
+    if (ret < 0)
+        return ret;
+
+    if (arg) {
+        stream = strdup(arg);
+        if (!stream)
+            return -ENOMEM;
+    }
+
+    /* Standby instance has its worker thread running, just take it. */
+    ctx = filter->opaque;
+    if (!ctx) {
+        ret = media_common_launch(priv, filter, &ctx);
+        if (ret < 0) {
+            free(stream);
+            return ret;
+        }
+    }
+
+    free(ctx->stream);
+    ctx->stream = stream;
+    ctx->cookie = cookie;
+
+    pthread_mutex_lock(&priv->postlock);
+    ctx->gen++;
+    pthread_mutex_unlock(&priv->postlock);
+
+    ctx->player = player;
+    ctx->idle = false;
+    if (player)
+        media_status_open(ctx);
+
+    *pctx = ctx;
+    return 0;
+}
+
+static void media_common_release(MediaFilterPriv* ctx)
+{
+    if (!ctx->standby) {
+        /* Resources released by CLOSED event. */
+        media_graph_queue_command(ctx->filter, "close", NULL,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+        return;
+    }
+
+    /* Recycle standby instance: keep worker thread, drop the stream. */
+    media_progress_stop(ctx);
+    media_status_close(ctx);
+    media_common_abandon_focus(ctx);
+    ctx->cookie = NULL;
+    ctx->event = false;
+    ctx->closing = false;
+    media_common_close_next(ctx);
+    media_graph_queue_command(ctx->filter, "reset", NULL,
+        NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    ctx->idle = true;
+}
+
+static void media_graph_standby(MediaGraphPriv* priv, const char** names)
+{
+    AVFilterContext* filter;
+    AVFilterGraph* graph;
+    MediaFilterPriv* ctx;
+    int i, j, k, count;
+
+    /* Pre-open a few instances of each filter type, so open/close of
+     * player&recorder need not create and destroy worker threads. */
+    for (j = 0; names[j]; j++) {
+        count = 0;
+
+        for (k = 0; k < priv->nb_subgraphs; k++) {
+            graph = priv->subgraphs[k].graph;
+
+            for (i = 0; i < graph->nb_filters; i++) {
+                if (count >= CONFIG_MEDIA_GRAPH_STANDBY_FILTERS)
+                    break;
+
+                filter = graph->filters[i];
+                if (filter->opaque || strcmp(filter->filter->name, names[j]))
+                    continue;
+
+                if (media_common_launch(priv, filter, &ctx) < 0)
+                    continue;
+
+                ctx->standby = true;
+                ctx->idle = true;
+                count++;
+            }
+        }
+    }
+}
+
+/* Standby instance is never closed so CLOSED won't come, pending close
+ * recycles it once current track completes or it is stopped. */
+static int media_common_close_standby(MediaFilterPriv* ctx, bool pending)
+{
+    long playing = 0;
+    char tmp[32];
+
+    if (pending)
+        if (media_graph_queue_command(ctx->filter, "get_playing", NULL,
+                tmp, sizeof(tmp), AV_OPT_SEARCH_CHILDREN) >= 0)
+            playing = strtol(tmp, NULL, 0);
+
+    if (playing) {
+        ctx->closing = true;
+        return 0;
+    }
+
+    media_stub_notify_finalize(&ctx->cookie);
+    media_common_release(ctx);
+    return 0;
+}
+
+/* State, volume, position, duration and latency in one reply, same order
+ * and flags as media_metadata_t, fields failed to get are left out. */
+static int media_player_query(MediaFilterPriv* ctx, char* res, int res_len)
+{
+    long state = 0, position = 0, duration = 0, latency = 0;
+    int flags = 0, volume = 0;
+
+    if (media_player_query_one(ctx->filter, "get_playing", &state) >= 0)
+        flags |= MEDIA_METAFLAG_STATE;
+
+    if (ctx->stream && media_stub_get_stream_volume(ctx->stream, &volume) >= 0)
+        flags |= MEDIA_METAFLAG_VOLUME;
+
+    if (media_player_query_one(ctx->filter, "get_position", &position) >= 0)
+        flags |= MEDIA_METAFLAG_POSITION;
+
+    if (media_player_query_one(ctx->filter, "get_duration", &duration) >= 0)
+        flags |= MEDIA_METAFLAG_DURATION;
+
+    if (media_player_query_one(ctx->filter, "get_latency", &latency) >= 0)
+        flags |= MEDIA_METAFLAG_LATENCY;
+
+    if (!flags)
+        return -EINVAL;
+
+    snprintf(res, res_len, "%d:%d:%d:%u:%u:%u", flags, (int)state, volume,
+        (unsigned)position, (unsigned)duration, (unsigned)latency);
+    return 0;
+}
+
 static int media_common_handler(MediaGraphPriv* priv, void* cookie,
     const char* target, const char* cmd, const char* arg,
     char* res, int res_len, bool player)
@@ -440,7 +2305,7 @@ static int media_common_handler(MediaGraphPriv* priv, void* cookie,
     MediaFilterPriv* ctx = media_server_get_data(cookie);
     AVFilterContext* filter = NULL;
     char url[PATH_MAX];
-    int pending;
+    int pending = 0;
     int ret = 0;
 
     if (!strcmp(cmd, "open")) {
@@ -460,6 +2325,75 @@ static int media_common_handler(MediaGraphPriv* priv, void* cookie,
         return 0;
     }
 
+    if (player && (!strcmp(cmd, "load_sound") || !strcmp(cmd, "play_sound")
+        || !strcmp(cmd, "unload_sound")))
+        return media_sound_handler(ctx, cmd, arg);
+
+    if (!strcmp(cmd, "start_auto"))
+        return media_common_start_auto(ctx, arg);
+
+    if (player && !strcmp(cmd, "query"))
+        return media_player_query(ctx, res, res_len);
+
+    if (player && !strcmp(cmd, "set_progress"))
+        return media_progress_set(ctx, arg);
+
+    if (!strcmp(cmd, "pause") || !strcmp(cmd, "stop")
+        || !strcmp(cmd, "reset") || !strcmp(cmd, "close"))
+        media_common_abandon_focus(ctx);
+
+    if (player && !strcmp(cmd, "set_next_options")) {
+        /* Gapless: options always come first, start from a fresh source. */
+        media_common_close_next(ctx);
+        ret = media_graph_queue_command(ctx->filter, cmd, arg,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+        if (ret != -ENOSYS)
+            return ret;
+
+        ret = media_common_open_next(ctx);
+        if (ret < 0)
+            return ret;
+
+        return media_graph_queue_command(ctx->next->filter, "set_options", arg,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    }
+
+    if (player && !strcmp(cmd, "queue_next")) {
+        /* Gapless: filter primes the next decoder and switches to it in
+         * its own output, sample accurate, then sends SWITCHED itself. */
+        ret = media_graph_queue_command(ctx->filter, cmd, arg,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+        if (ret != -ENOSYS) {
+            media_common_close_next(ctx);
+            return ret;
+        }
+
+        /* Filter can't, probe next source on another input of the same
+         * stream now, start it at end of current. */
+        if (!arg || ctx->queued)
+            media_common_close_next(ctx);
+
+        if (!arg)
+            return 0;
+
+        ret = media_common_open_next(ctx);
+        if (ret < 0)
+            return ret;
+
+        ret = media_graph_queue_command(ctx->next->filter, "prepare", arg,
+            NULL, 0, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            media_common_close_next(ctx);
+            return ret;
+        }
+
+        ctx->queued = true;
+        return 0;
+    }
+
+    if (!strcmp(cmd, "prepare") || !strcmp(cmd, "stop") || !strcmp(cmd, "reset"))
+        media_common_close_next(ctx);
+
     if (!strcmp(cmd, "prepare") && target) {
         /* Buffer mode, use `target` as cpuname, `arg` as sockname. */
         if (!strcmp(target, CONFIG_RPMSG_LOCAL_CPUNAME))
@@ -469,10 +2403,15 @@ static int media_common_handler(MediaGraphPriv* priv, void* cookie,
 
         arg = url;
     } else if (!strcmp(cmd, "close")) {
+        media_sound_close(ctx);
+
         /* Direct end notification if close without pending. */
         if (arg)
             sscanf(arg, "%d", &pending);
 
+        if (ctx->standby)
+            return media_common_close_standby(ctx, player && pending);
+
         if (!arg || !pending)
             media_stub_notify_finalize(&ctx->cookie);
     } else if (target) {
@@ -485,7 +2424,7 @@ static int media_common_handler(MediaGraphPriv* priv, void* cookie,
     if (!filter)
         filter = ctx->filter;
 
-    return media_graph_queue_command(priv, filter, cmd, arg,
+    return media_graph_queue_command(filter, cmd, arg,
         res, res_len, AV_OPT_SEARCH_CHILDREN);
 }
 
@@ -496,48 +2435,69 @@ static int media_common_handler(MediaGraphPriv* priv, void* cookie,
 void* media_graph_create(void* file)
 {
     MediaGraphPriv* priv;
-    int ret;
+    int ret, i;
 
-    priv = malloc(sizeof(MediaGraphPriv));
+    priv = zalloc(sizeof(MediaGraphPriv));
     if (!priv)
         return NULL;
 
-    priv->fd = eventfd(0, EFD_CLOEXEC);
-    if (priv->fd < 0)
-        goto err;
-
-    ret = fs_getfilep(priv->fd, &priv->filep);
-    if (ret < 0)
-        goto err;
-
+    pthread_mutex_init(&priv->progress_lock, NULL);
+    pthread_mutex_init(&priv->postlock, NULL);
+    media_status_create(priv);
     ret = media_graph_load(priv, file);
     if (ret < 0)
         goto err;
 
-    priv->tid = gettid();
-    priv->cmdhead = NULL;
-    priv->cmdtail = NULL;
+    if (CONFIG_MEDIA_GRAPH_STANDBY_FILTERS > 0) {
+        media_graph_standby(priv, g_media_inputs);
+        media_graph_standby(priv, g_media_outputs);
+    }
+
+    /* The first subgraph is driven by mediad main loop, others by own thread. */
+    for (i = 1; i < priv->nb_subgraphs; i++) {
+        ret = media_subgraph_start(&priv->subgraphs[i], i);
+        if (ret < 0)
+            goto err;
+    }
 
     return priv;
 err:
-    if (priv->fd > 0)
-        close(priv->fd);
-    free(priv);
+    media_graph_destroy(priv);
     return NULL;
 }
 
 int media_graph_destroy(void* graph)
 {
     MediaGraphPriv* priv = graph;
-    int ret;
+    MediaFilterPriv* ctx;
+    MediaEvent* evt;
+    int i;
+
+    media_sound_destroy(priv);
+    for (i = priv->nb_subgraphs - 1; i >= 0; i--)
+        media_subgraph_destroy(&priv->subgraphs[i]);
+
+    /* Filters are gone, finish instances closed by their teardown. */
+    while ((evt = priv->posthead)) {
+        priv->posthead = evt->next;
+        if (evt->event != AVMOVIE_ASYNC_EVENT_CLOSED) {
+            free(evt);
+            continue;
+        }
 
-    do {
-        ret = media_graph_dequeue_command(priv, false);
-    } while (ret >= 0);
+        ctx = evt->ctx;
+        media_stub_notify_finalize(&ctx->cookie);
+        media_common_abandon_focus(ctx);
+        media_progress_stop(ctx);
+        media_status_close(ctx);
+        free(ctx->stream);
+        free(ctx);
+    }
 
-    avfilter_graph_free(&priv->graph);
+    pthread_mutex_destroy(&priv->progress_lock);
+    pthread_mutex_destroy(&priv->postlock);
+    media_status_destroy(priv);
     free(priv);
-
     return 0;
 }
 
@@ -545,82 +2505,58 @@ int media_graph_get_pollfds(void* graph, struct pollfd* fds,
     void** cookies, int count)
 {
     MediaGraphPriv* priv = graph;
-    int ret, nfd, i;
-
-    if (!fds || count < 2)
-        return -EINVAL;
-
-    fds[0].fd = priv->fd;
-    fds[0].events = POLLIN;
-    cookies[0] = NULL;
-    nfd = 1;
-
-    for (i = 0; i < priv->pollftn; i++) {
-        AVFilterContext* filter = priv->pollfts[i];
-
-        ret = avfilter_process_command(filter, "get_pollfd", NULL,
-            (char*)&fds[nfd], sizeof(struct pollfd) * (count - nfd),
-            AV_OPT_SEARCH_CHILDREN);
-        if (ret < 0)
-            continue;
+    int ret;
 
-        while (ret--) {
-            cookies[nfd++] = filter;
-            if (nfd > count)
-                return -EINVAL;
-        }
-    }
+    ret = media_subgraph_get_pollfds(&priv->subgraphs[0], fds, cookies, count);
+    if (ret < 0)
+        return ret;
 
-    return nfd;
+    ret += media_progress_get_pollfds(priv, fds + ret, cookies + ret, count - ret);
+    return ret + media_sound_get_pollfds(priv, fds + ret, cookies + ret, count - ret);
 }
 
 int media_graph_poll_available(void* graph, struct pollfd* fd, void* cookie)
 {
     MediaGraphPriv* priv = graph;
-    eventfd_t unuse;
+    int ret;
 
-    if (!fd)
-        return -EINVAL;
+    if (cookie && (media_progress_available(priv, cookie)
+        || media_sound_available(priv, cookie)))
+        return 0;
 
-    if (cookie)
-        avfilter_process_command(cookie, "poll_available", NULL,
-            (char*)fd, sizeof(struct pollfd),
-            AV_OPT_SEARCH_CHILDREN);
-    else
-        eventfd_read(priv->fd, &unuse);
+    ret = media_subgraph_poll_available(&priv->subgraphs[0], fd, cookie);
+    if (!cookie) {
+        media_common_run_posted(priv);
+        media_status_refresh(priv);
+    }
 
-    return 0;
+    return ret;
 }
 
 int media_graph_run_once(void* graph)
 {
     MediaGraphPriv* priv = graph;
-    int ret;
-
-    ret = ff_filter_graph_run_all(priv->graph);
-    if (ret < 0)
-        return ret;
 
-    do {
-        ret = media_graph_dequeue_command(priv, true);
-    } while (ret >= 0);
-
-    return ret == -EAGAIN ? 0 : ret;
+    return media_subgraph_run_once(&priv->subgraphs[0]);
 }
 
 int media_graph_handler(void* graph, const char* target, const char* cmd,
     const char* arg, char* res, int res_len)
 {
     MediaGraphPriv* priv = graph;
-    int i, ret = 0;
+    AVFilterGraph* subgraph;
+    int i, k, ret = 0;
     char* dump;
 
     if (!target && !strcmp(cmd, "dump")) {
-        dump = avfilter_graph_dump_ext(priv->graph, arg);
-        if (dump)
-            MEDIA_INFO("\n%s\n", dump);
+        for (k = 0; k < priv->nb_subgraphs; k++) {
+            dump = avfilter_graph_dump_ext(priv->subgraphs[k].graph, arg);
+            if (dump)
+                MEDIA_INFO("\n%s\n", dump);
+
+            free(dump);
+        }
 
-        free(dump);
         return 0;
     } else if (!strcmp(cmd, "loglevel")) {
         if (!arg)
@@ -633,25 +2569,94 @@ int media_graph_handler(void* graph, const char* target, const char* cmd,
     if (!target)
         return -EINVAL;
 
-    for (i = 0; i < priv->graph->nb_filters; i++) {
-        AVFilterContext* filter = priv->graph->filters[i];
+    for (k = 0; k < priv->nb_subgraphs; k++) {
+        subgraph = priv->subgraphs[k].graph;
 
-        if (!strcmp(target, filter->name))
-            ret = media_graph_queue_command(priv, filter, cmd, arg, res, res_len, 0);
-        else {
-            const char* tmp = strchr(filter->name, '@');
+        for (i = 0; i < subgraph->nb_filters; i++) {
+            AVFilterContext* filter = subgraph->filters[i];
 
-            if (tmp && !strncmp(tmp + 1, target, strlen(target)))
-                ret = media_graph_queue_command(priv, filter, cmd, arg, res, res_len, 0);
-        }
+            if (media_graph_match_filter(filter, target))
+                ret = media_graph_queue_command(filter, cmd, arg, res, res_len, 0);
 
-        if (ret < 0)
-            return ret;
+            if (ret < 0)
+                return ret;
+        }
     }
 
     return 0;
 }
 
+int media_graph_find_filters(void* graph, const char* target,
+    void** filters, int nb)
+{
+    MediaGraphPriv* priv = graph;
+    AVFilterGraph* subgraph;
+    int i, k, count = 0;
+
+    if (!priv || !target)
+        return -EINVAL;
+
+    for (k = 0; k < priv->nb_subgraphs; k++) {
+        subgraph = priv->subgraphs[k].graph;
+
+        for (i = 0; i < subgraph->nb_filters; i++) {
+            if (!media_graph_match_filter(subgraph->filters[i], target))
+                continue;
+
+            if (count < nb)
+                filters[count] = subgraph->filters[i];
+
+            count++;
+        }
+    }
+
+    return count;
+}
+
+int media_graph_filter_command(void* filter, const char* cmd, const char* arg)
+{
+    if (!filter || !cmd)
+        return -EINVAL;
+
+    return media_graph_queue_command(filter, cmd, arg, NULL, 0, 0);
+}
+
+void media_graph_disconnect(void* graph, void* cookie)
+{
+    MediaGraphPriv* priv = graph;
+    AVFilterGraph* subgraph;
+    MediaFilterPriv* ctx;
+    int i, k;
+
+    if (!priv || !cookie)
+        return;
+
+    /* Peer is gone without close, nobody can abandon the focus its
+     * start_auto requested, and its connection may be reused. */
+    for (k = 0; k < priv->nb_subgraphs; k++) {
+        subgraph = priv->subgraphs[k].graph;
+
+        for (i = 0; i < subgraph->nb_filters; i++) {
+            ctx = subgraph->filters[i]->opaque;
+            if (!ctx || ctx->cookie != cookie)
+                continue;
+
+            media_common_abandon_focus(ctx);
+            ctx->event = false;
+            media_stub_notify_finalize(&ctx->cookie);
+        }
+    }
+}
+
+int media_graph_set_policy_status(void* graph, const char* name,
+    int number, const char* literal)
+{
+    if (!graph || !name || !name[0])
+        return -EINVAL;
+
+    return media_status_set_criterion(graph, name, number, literal);
+}
+
 int media_player_handler(void* graph, void* cookie, const char* target, const char* cmd,
     const char* arg, char* res, int res_len)
 {
@@ -32,7 +32,10 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
+#include <sys/queue.h>
+#include <unistd.h>
 
 #include "media_common.h"
 #include "media_server.h"
@@ -43,6 +46,14 @@
 
 #define MEDIA_PERSIST "persist.media."
 
+#ifndef CONFIG_MEDIA_POLICY_PERSIST_DELAY
+#define CONFIG_MEDIA_POLICY_PERSIST_DELAY 1000
+#endif
+
+#ifndef CONFIG_MEDIA_STATUS_CRITERIA
+#define CONFIG_MEDIA_STATUS_CRITERIA ""
+#endif
+
 /****************************************************************************
  * Private Functions Prototype
  ****************************************************************************/
@@ -54,16 +65,93 @@ static void pfw_set_parameter_callback(void* cookie, const char* params);
  * Private Data
  ****************************************************************************/
 
+/* Persisted criterion changed since last flush, one per key. */
+
+typedef struct MediaPersistItem {
+    TAILQ_ENTRY(MediaPersistItem) entry;
+    int value;
+    char key[];
+} MediaPersistItem;
+
+TAILQ_HEAD(MediaPersistList, MediaPersistItem);
+
 typedef struct MediaPolicyPriv {
     struct work_s work; /* Used for save kvdb */
     pthread_mutex_t mutex;
-    char key[64];
-    int value;
+    struct MediaPersistList dirty;
 } MediaPolicyPriv;
 
+/* Device opened by SetParameter, kept open across applies. */
+
+typedef struct MediaDevicePriv {
+    TAILQ_ENTRY(MediaDevicePriv) entry;
+    char* path;
+    int fd;
+    const char* last; /* Last parameter written, points into a MediaParamPriv. */
+} MediaDevicePriv;
+
+/* SetParameter params string, tokenized once into {device, args}*. */
+
+typedef struct MediaParamItem {
+    const char* arg;
+    MediaDevicePriv* dev;
+} MediaParamItem;
+
+typedef struct MediaParamPriv {
+    TAILQ_ENTRY(MediaParamPriv) entry;
+    char* params;
+    char* buf;
+    int nb_items;
+    MediaParamItem items[];
+} MediaParamPriv;
+
+/* FFmpegCommand params string, compiled once into {filters, cmd, arg}*. */
+
+typedef struct MediaCommandItem {
+    const char* cmd;
+    const char* arg;
+    void** filters;
+    int nb_filters;
+} MediaCommandItem;
+
+typedef struct MediaCommandPriv {
+    TAILQ_ENTRY(MediaCommandPriv) entry;
+    char* params;
+    char* buf;
+    int nb_items;
+    MediaCommandItem items[];
+} MediaCommandPriv;
+
+/* Plugins run wherever the policy is applied, worker threads included
+ * (media_stub_set_stream_status), so the cache is under `lock`. Entries
+ * live till media_policy_destroy, items are used after unlock. */
+
+typedef struct MediaParamCache {
+    pthread_mutex_t lock;
+    TAILQ_HEAD(, MediaDevicePriv) devices;
+    TAILQ_HEAD(, MediaParamPriv) params;
+    TAILQ_HEAD(, MediaCommandPriv) commands;
+} MediaParamCache;
+
+static MediaParamCache g_media_param_cache = {
+    PTHREAD_MUTEX_INITIALIZER,
+    TAILQ_HEAD_INITIALIZER(g_media_param_cache.devices),
+    TAILQ_HEAD_INITIALIZER(g_media_param_cache.params),
+    TAILQ_HEAD_INITIALIZER(g_media_param_cache.commands),
+};
+
+/* Criteria published in the status page, subscribed till destroy. */
+
+typedef struct MediaStatusCriterion {
+    char* name;
+    void* handle;
+} MediaStatusCriterion;
+
+static MediaStatusCriterion g_media_status_criteria[MEDIA_STATUS_CRITERIA];
+
 static pfw_plugin_def_t g_media_policy_plugins[] = {
-    { "FFmpegCommand", NULL, pfw_ffmpeg_command_callback },
-    { "SetParameter", NULL, pfw_set_parameter_callback }
+    { "FFmpegCommand", &g_media_param_cache, pfw_ffmpeg_command_callback },
+    { "SetParameter", &g_media_param_cache, pfw_set_parameter_callback }
 };
 
 static const size_t g_media_policy_nb_plugins = sizeof(g_media_policy_plugins)
@@ -73,9 +161,26 @@ static const size_t g_media_policy_nb_plugins = sizeof(g_media_policy_plugins)
  * Private Functions
  ****************************************************************************/
 
-static void pfw_ffmpeg_command_callback(void* cookie, const char* params)
+static void media_command_free(MediaCommandPriv* command)
 {
-    char *target, *cmd, *arg, *outptr, *inptr, *str;
+    int i;
+
+    for (i = 0; i < command->nb_items; i++)
+        free(command->items[i].filters);
+
+    free(command->params);
+    free(command->buf);
+    free(command);
+}
+
+static MediaCommandPriv* media_command_parse(MediaParamCache* cache,
+    const char* params)
+{
+    char *target, *cmd, *arg, *outptr, *inptr;
+    MediaCommandPriv* command;
+    MediaCommandItem* item;
+    int nb = 1;
+    int i;
 
     /* fmt:
      *  {target,cmd,arg;}*
@@ -83,34 +188,198 @@ static void pfw_ffmpeg_command_callback(void* cookie, const char* params)
      *  sco,sample_rate,16000;sco,play,;
      */
 
-    str = strdup(params);
-    if (!str)
-        return;
+    TAILQ_FOREACH(command, &cache->commands, entry)
+    {
+        if (!strcmp(command->params, params))
+            return command;
+    }
 
-    target = strtok_r(str, ";", &outptr);
-    while (target) {
+    for (i = 0; params[i]; i++)
+        nb += params[i] == ';';
+
+    command = zalloc(sizeof(MediaCommandPriv) + nb * sizeof(MediaCommandItem));
+    if (!command)
+        return NULL;
+
+    command->params = strdup(params);
+    command->buf = strdup(params);
+    if (!command->params || !command->buf)
+        goto err;
+
+    target = strtok_r(command->buf, ";", &outptr);
+    while (target && command->nb_items < nb) {
         target = strtok_r(target, ",", &inptr);
         if (!target)
-            goto out;
+            break;
 
         cmd = strtok_r(NULL, ",", &inptr);
         if (!cmd)
-            goto out;
+            break;
 
         arg = strtok_r(NULL, ",", &inptr);
-        media_stub_process_command(target, cmd, arg);
+
+        /* Resolve target to filters now, graph is fixed once created. */
+
+        item = &command->items[command->nb_items++];
+        item->cmd = cmd;
+        item->arg = arg;
+        item->nb_filters = media_stub_find_filters(target, NULL, 0);
+        if (item->nb_filters > 0) {
+            item->filters = malloc(item->nb_filters * sizeof(void*));
+            if (!item->filters)
+                goto err;
+
+            media_stub_find_filters(target, item->filters, item->nb_filters);
+        }
 
         target = strtok_r(NULL, ";", &outptr);
     }
 
-out:
-    free(str);
+    TAILQ_INSERT_TAIL(&cache->commands, command, entry);
+    return command;
+
+err:
+    media_command_free(command);
+    return NULL;
+}
+
+static void pfw_ffmpeg_command_callback(void* cookie, const char* params)
+{
+    MediaParamCache* cache = cookie;
+    MediaCommandPriv* command;
+    MediaCommandItem* item;
+    int i, j;
+
+    /* Don't hold the lock while filters run the commands. */
+    pthread_mutex_lock(&cache->lock);
+    command = media_command_parse(cache, params);
+    pthread_mutex_unlock(&cache->lock);
+    if (!command)
+        return;
+
+    for (i = 0; i < command->nb_items; i++) {
+        item = &command->items[i];
+        for (j = 0; j < item->nb_filters; j++)
+            media_stub_filter_command(item->filters[j], item->cmd, item->arg);
+    }
+}
+
+static MediaDevicePriv* media_param_get_device(MediaParamCache* cache,
+    const char* path)
+{
+    MediaDevicePriv* dev;
+
+    TAILQ_FOREACH(dev, &cache->devices, entry)
+    {
+        if (!strcmp(dev->path, path))
+            return dev;
+    }
+
+    dev = zalloc(sizeof(MediaDevicePriv));
+    if (!dev)
+        return NULL;
+
+    dev->path = strdup(path);
+    if (!dev->path) {
+        free(dev);
+        return NULL;
+    }
+
+    dev->fd = -1;
+    TAILQ_INSERT_TAIL(&cache->devices, dev, entry);
+    return dev;
+}
+
+static MediaParamPriv* media_param_parse(MediaParamCache* cache,
+    const char* params)
+{
+    char *target, *arg, *outptr, *saveptr;
+    MediaParamPriv* param;
+    int nb = 1;
+    int i;
+
+    /* Cached by content, pfw gives the same string of an action each apply. */
+
+    TAILQ_FOREACH(param, &cache->params, entry)
+    {
+        if (!strcmp(param->params, params))
+            return param;
+    }
+
+    for (i = 0; params[i]; i++)
+        nb += params[i] == ';';
+
+    param = zalloc(sizeof(MediaParamPriv) + nb * sizeof(MediaParamItem));
+    if (!param)
+        return NULL;
+
+    param->params = strdup(params);
+    param->buf = strdup(params);
+    if (!param->params || !param->buf)
+        goto err;
+
+    outptr = strtok_r(param->buf, ";", &saveptr);
+
+    while (outptr && param->nb_items < nb) {
+        target = strtok_r(outptr, ",", &arg);
+        if (target == NULL)
+            break;
+
+        if (arg != NULL) {
+            param->items[param->nb_items].arg = arg;
+            param->items[param->nb_items].dev = media_param_get_device(cache, target);
+            if (!param->items[param->nb_items].dev)
+                goto err;
+
+            param->nb_items++;
+        }
+
+        outptr = strtok_r(NULL, ";", &saveptr);
+    }
+
+    TAILQ_INSERT_TAIL(&cache->params, param, entry);
+    return param;
+
+err:
+    free(param->params);
+    free(param->buf);
+    free(param);
+    return NULL;
+}
+
+static void media_param_cache_clear(MediaParamCache* cache)
+{
+    MediaCommandPriv* command;
+    MediaDevicePriv* dev;
+    MediaParamPriv* param;
+
+    while ((command = TAILQ_FIRST(&cache->commands))) {
+        TAILQ_REMOVE(&cache->commands, command, entry);
+        media_command_free(command);
+    }
+
+    while ((param = TAILQ_FIRST(&cache->params))) {
+        TAILQ_REMOVE(&cache->params, param, entry);
+        free(param->params);
+        free(param->buf);
+        free(param);
+    }
+
+    while ((dev = TAILQ_FIRST(&cache->devices))) {
+        TAILQ_REMOVE(&cache->devices, dev, entry);
+        if (dev->fd >= 0)
+            close(dev->fd);
+        free(dev->path);
+        free(dev);
+    }
 }
 
 static void pfw_set_parameter_callback(void* cookie, const char* params)
 {
-    char *target, *arg, *outptr, *saveptr, *str;
-    int fd = 0;
+    MediaParamCache* cache = cookie;
+    MediaParamPriv* param;
+    MediaDevicePriv* dev;
+    int i;
 
     /* fmt:
      *  target_1,args_1;target_2,args_2;...;target_n,args_n
@@ -118,35 +387,59 @@ static void pfw_set_parameter_callback(void* cookie, const char* params)
      *  dev/audio/mixer1,mode=normal,outdev0=speaker;dev/audio/mixer2,indev=mic;
      */
 
-    str = strdup(params);
-    if (!str)
-        return;
+    pthread_mutex_lock(&cache->lock);
 
-    outptr = strtok_r(str, ";", &saveptr);
+    /* Devices remember their last parameters, keep the lock while writing. */
+    param = media_param_parse(cache, params);
+    if (!param)
+        goto out;
 
-    while (outptr) {
-        target = strtok_r(outptr, ",", &arg);
-        if (target == NULL)
-            goto out;
+    for (i = 0; i < param->nb_items; i++) {
+        dev = param->items[i].dev;
 
-        if (arg != NULL && target != NULL) {
-            fd = open(target, O_RDWR | O_CLOEXEC);
-            if (fd < 0)
-                goto out;
+        /* Device already has these parameters. */
+
+        if (dev->last && !strcmp(dev->last, param->items[i].arg))
+            continue;
 
-            if (ioctl(fd, AUDIOIOC_SETPARAMTER, arg) < 0) {
-                close(fd);
+        if (dev->fd < 0) {
+            dev->fd = open(dev->path, O_RDWR | O_CLOEXEC);
+            if (dev->fd < 0)
                 goto out;
-            }
+        }
 
-            close(fd);
+        if (ioctl(dev->fd, AUDIOIOC_SETPARAMTER, param->items[i].arg) < 0) {
+            close(dev->fd);
+            dev->fd = -1;
+            dev->last = NULL;
+            goto out;
         }
 
-        outptr = strtok_r(NULL, ";", &saveptr);
+        dev->last = param->items[i].arg;
     }
 
 out:
-    free(str);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void pfw_save_criterion_work(void* args)
+{
+    MediaPolicyPriv* priv = args;
+    struct MediaPersistList dirty;
+    MediaPersistItem* item;
+
+    /* Take the whole journal, so saving never blocks pfw. */
+
+    TAILQ_INIT(&dirty);
+    pthread_mutex_lock(&priv->mutex);
+    TAILQ_CONCAT(&dirty, &priv->dirty, entry);
+    pthread_mutex_unlock(&priv->mutex);
+
+    while ((item = TAILQ_FIRST(&dirty))) {
+        TAILQ_REMOVE(&dirty, item, entry);
+        property_set_int32(item->key, item->value);
+        free(item);
+    }
 }
 
 static void pfw_cookie_release_cb(void* cookie)
@@ -154,6 +447,8 @@ static void pfw_cookie_release_cb(void* cookie)
     MediaPolicyPriv* priv = cookie;
 
     if (priv) {
+        work_cancel(HPWORK, &priv->work);
+        pfw_save_criterion_work(priv);
         pthread_mutex_destroy(&priv->mutex);
         free(priv);
     }
@@ -165,37 +460,204 @@ static void pfw_load_criterion_cb(void* cookie, const char* name, int32_t* state
         *state = property_get_int32(name, *state);
 }
 
-static void pfw_save_criterion_work(void* args)
+static void pfw_save_criterion_cb(void* cookie, const char* name, int32_t state)
 {
-    MediaPolicyPriv* priv = args;
-    char tmp[64];
-    int value;
+    MediaPolicyPriv* priv = cookie;
+    MediaPersistItem* item;
+
+    if (strncmp(name, MEDIA_PERSIST, strlen(MEDIA_PERSIST)))
+        return;
 
     pthread_mutex_lock(&priv->mutex);
-    strlcpy(tmp, priv->key, sizeof(tmp));
-    value = priv->value;
+
+    /* Coalesce changes of the same key, only the latest is saved. */
+
+    TAILQ_FOREACH(item, &priv->dirty, entry)
+    {
+        if (!strcmp(item->key, name))
+            break;
+    }
+
+    if (!item) {
+        item = malloc(sizeof(MediaPersistItem) + strlen(name) + 1);
+        if (!item) {
+            pthread_mutex_unlock(&priv->mutex);
+            MEDIA_ERR("no memory to save %s:%d\n", name, state);
+            return;
+        }
+
+        strcpy(item->key, name);
+        TAILQ_INSERT_TAIL(&priv->dirty, item, entry);
+    }
+
+    item->value = state;
+
+    /* Flush at most DELAY after the first change, even if changes keep
+     * coming, so a burst is written in one go. */
+
+    if (work_available(&priv->work))
+        work_queue(HPWORK, &priv->work, pfw_save_criterion_work, priv,
+            MSEC2TICK(CONFIG_MEDIA_POLICY_PERSIST_DELAY));
+
     pthread_mutex_unlock(&priv->mutex);
+}
 
-    property_set_int32(tmp, value);
+static void media_policy_notify_cb(void* cookie, int number, char* literal)
+{
+    media_stub_notify_event(cookie, 0, number, literal);
 }
 
-static void pfw_save_criterion_cb(void* cookie, const char* name, int32_t state)
+static void media_policy_status_cb(void* cookie, int number, char* literal)
 {
-    MediaPolicyPriv* priv = cookie;
+    media_stub_set_policy_status(cookie, number, literal);
+}
 
-    if (!strncmp(name, MEDIA_PERSIST, strlen(MEDIA_PERSIST))) {
-        pthread_mutex_lock(&priv->mutex);
-        strlcpy(priv->key, name, sizeof(priv->key));
-        priv->value = state;
-        pthread_mutex_unlock(&priv->mutex);
+static void media_policy_status_subscribe(void* policy)
+{
+    char *str, *name, *saveptr, literal[MEDIA_STATUS_LITERAL_LEN];
+    MediaStatusCriterion* criterion;
+    int i = 0, number;
 
-        work_queue(HPWORK, &priv->work, pfw_save_criterion_work, priv, MSEC2TICK(1000));
+    str = strdup(CONFIG_MEDIA_STATUS_CRITERIA);
+    if (!str)
+        return;
+
+    for (name = strtok_r(str, ", ", &saveptr); name && i < MEDIA_STATUS_CRITERIA;
+         name = strtok_r(NULL, ", ", &saveptr)) {
+        criterion = &g_media_status_criteria[i];
+        criterion->name = strdup(name);
+        if (!criterion->name)
+            break;
+
+        /* Publish current state, then changes as they come. */
+        if (pfw_getint(policy, name, &number) < 0) {
+            MEDIA_WARN("unknown status criterion %s\n", name);
+            free(criterion->name);
+            criterion->name = NULL;
+            continue;
+        }
+
+        if (pfw_getstring(policy, name, literal, sizeof(literal)) < 0)
+            literal[0] = '\0';
+
+        if (media_stub_set_policy_status(name, number, literal) < 0) {
+            free(criterion->name);
+            criterion->name = NULL;
+            break;
+        }
+
+        criterion->handle = pfw_subscribe(policy, criterion->name,
+            media_policy_status_cb, criterion->name);
+        i++;
     }
+
+    free(str);
 }
 
-static void media_policy_notify_cb(void* cookie, int number, char* literal)
+static void media_policy_status_unsubscribe(void* policy)
 {
-    media_stub_notify_event(cookie, 0, number, literal);
+    MediaStatusCriterion* criterion;
+    int i;
+
+    for (i = 0; i < MEDIA_STATUS_CRITERIA; i++) {
+        criterion = &g_media_status_criteria[i];
+        if (criterion->handle)
+            pfw_unsubscribe(policy, criterion->handle);
+
+        free(criterion->name);
+        criterion->name = NULL;
+        criterion->handle = NULL;
+    }
+}
+
+static int media_policy_change(void* policy, const char* name,
+    const char* cmd, const char* value)
+{
+    if (!strcmp(cmd, "set_int"))
+        return value ? pfw_setint(policy, name, atoi(value)) : -EINVAL;
+    else if (!strcmp(cmd, "increase"))
+        return pfw_increase(policy, name);
+    else if (!strcmp(cmd, "decrease"))
+        return pfw_decrease(policy, name);
+    else if (!strcmp(cmd, "set_string"))
+        return pfw_setstring(policy, name, value);
+    else if (!strcmp(cmd, "include"))
+        return pfw_include(policy, name, value);
+    else if (!strcmp(cmd, "exclude"))
+        return pfw_exclude(policy, name, value);
+
+    return -ENOSYS;
+}
+
+static int media_policy_batch(void* policy, const char* changes)
+{
+    char *str, *line, *next, *name, *value;
+    struct {
+        const char* name;
+        int state;
+    }* saved;
+    int nb = 0, ret = 0;
+
+    /* fmt:
+     *  {cmd\tname\tvalue\n}*
+     * all changes or none of them are made, criterion state is int32 for
+     * every criterion type (as persist.media.* saves), used for rollback.
+     */
+
+    if (!changes)
+        return -EINVAL;
+
+    str = strdup(changes);
+    if (!str)
+        return -ENOMEM;
+
+    for (line = str; *line; line++)
+        nb += *line == '\n';
+
+    saved = malloc((nb + 1) * sizeof(*saved));
+    if (!saved) {
+        free(str);
+        return -ENOMEM;
+    }
+
+    for (nb = 0, line = str; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        name = strchr(line, '\t');
+        if (!name) {
+            ret = -EINVAL;
+            break;
+        }
+        *name++ = '\0';
+
+        value = strchr(name, '\t');
+        if (value)
+            *value++ = '\0';
+        if (value && !value[0])
+            value = NULL;
+
+        ret = pfw_getint(policy, name, &saved[nb].state);
+        if (ret < 0)
+            break;
+
+        ret = media_policy_change(policy, name, line, value);
+        if (ret < 0)
+            break;
+
+        saved[nb++].name = name;
+    }
+
+    if (ret < 0) {
+        MEDIA_WARN("batch failed at %d: %d, rollback.\n", nb, ret);
+        while (nb-- > 0)
+            pfw_setint(policy, saved[nb].name, saved[nb].state);
+    }
+
+    free(saved);
+    free(str);
+    return ret;
 }
 
 /****************************************************************************
@@ -224,18 +686,9 @@ int media_policy_handler(void* policy, void* cookie, const char* name, const cha
         pfw_unsubscribe(policy, handle);
         media_stub_notify_finalize(&cookie);
         return 0;
-    } else if (!strcmp(cmd, "set_int")) {
-        ret = pfw_setint(policy, name, atoi(value));
-    } else if (!strcmp(cmd, "increase")) {
-        ret = pfw_increase(policy, name);
-    } else if (!strcmp(cmd, "decrease")) {
-        ret = pfw_decrease(policy, name);
-    } else if (!strcmp(cmd, "set_string")) {
-        ret = pfw_setstring(policy, name, value);
-    } else if (!strcmp(cmd, "include")) {
-        ret = pfw_include(policy, name, value);
-    } else if (!strcmp(cmd, "exclude")) {
-        ret = pfw_exclude(policy, name, value);
+    } else if (!strcmp(cmd, "batch")) {
+        /* Several changes, rules are evaluated once below. */
+        ret = media_policy_batch(policy, value);
     } else if (!strcmp(cmd, "contain")) {
         ret = pfw_contain(policy, name, value, &tmp[0]);
         if (ret >= 0) {
@@ -268,6 +721,10 @@ int media_policy_handler(void* policy, void* cookie, const char* name, const cha
         MEDIA_DEBUG("\n%s", dump);
         free(dump);
         return 0;
+    } else {
+        /* set_int, increase, decrease, set_string, include, exclude,
+         * -ENOSYS for others. */
+        ret = media_policy_change(policy, name, cmd, value);
     }
 
     MEDIA_DEBUG("%s %s %s %s ret:%d.",
@@ -284,7 +741,11 @@ int media_policy_handler(void* policy, void* cookie, const char* name, const cha
 
 int media_policy_destroy(void* policy)
 {
+    media_policy_status_unsubscribe(policy);
     pfw_destroy(policy, pfw_cookie_release_cb);
+    pthread_mutex_lock(&g_media_param_cache.lock);
+    media_param_cache_clear(&g_media_param_cache);
+    pthread_mutex_unlock(&g_media_param_cache.lock);
     return 0;
 }
 
@@ -302,6 +763,7 @@ void* media_policy_create(void* params)
         return NULL;
 
     pthread_mutex_init(&priv->mutex, NULL);
+    TAILQ_INIT(&priv->dirty);
 
     policy = pfw_create(paths[0], paths[1], g_media_policy_plugins,
         g_media_policy_nb_plugins, pfw_load_criterion_cb, pfw_save_criterion_cb, (void*)priv);
@@ -309,5 +771,6 @@ void* media_policy_create(void* params)
         return NULL;
 
     pfw_apply(policy);
+    media_policy_status_subscribe(policy);
     return policy;
 }
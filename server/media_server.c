@@ -123,6 +123,10 @@ static int media_server_create_notify(struct media_server_priv* priv, media_parc
 
 static void media_server_conn_close(struct media_server_conn* conn)
 {
+    /* Release what the peer still holds, it may have crashed. */
+
+    media_stub_onclose(conn);
+
     close(conn->tran_fd);
     conn->tran_fd = -EPERM;
     conn->offset = 0;
@@ -52,11 +52,19 @@ void media_stub_notify_event(void* cookie, int event,
     int result, const char* extra);
 void media_stub_onreceive(void* cookie,
     struct media_parcel* in, struct media_parcel* out);
+void media_stub_onclose(void* cookie);
 
 int media_stub_set_stream_status(const char* name, bool active);
 int media_stub_get_stream_name(const char* stream, char* name, int len);
+int media_stub_get_stream_volume(const char* stream, int* volume);
+int media_stub_set_policy_status(const char* name, int number, const char* literal);
 int media_stub_process_command(const char* target,
     const char* cmd, const char* arg);
+int media_stub_find_filters(const char* target, void** filters, int nb);
+int media_stub_filter_command(void* filter, const char* cmd, const char* arg);
+void* media_stub_request_focus(const char* scenario, int* suggestion,
+    media_focus_callback on_suggestion, void* cookie);
+int media_stub_abandon_focus(void* handle);
 
 /****************************************************************************
  * Server Functions
@@ -88,6 +96,7 @@ typedef struct media_focus_id {
     int focus_state;
     media_focus_callback callback_method;
     void* callback_argv;
+    int suggestion;
 } media_focus_id;
 
 void* media_focus_create(void* file);
@@ -95,6 +104,11 @@ int media_focus_destroy(void* focus);
 int media_focus_handler(void* focus, void* cookie, const char* name,
     const char* cmd, char* res, int res_len);
 
+void* media_focus_acquire(void* focus, const char* scenario, int* suggestion,
+    media_focus_callback on_suggestion, void* cookie);
+int media_focus_release(void* focus, void* handle);
+void media_focus_disconnect(void* focus, void* cookie);
+
 void media_focus_debug_stack_display(void);
 int media_focus_debug_stack_return(media_focus_id* focus_list, int num);
 
@@ -110,6 +124,12 @@ int media_graph_poll_available(void* graph, struct pollfd* fd, void* cookie);
 int media_graph_run_once(void* graph);
 int media_graph_handler(void* graph, const char* target,
     const char* cmd, const char* arg, char* res, int res_len);
+int media_graph_find_filters(void* graph, const char* target,
+    void** filters, int nb);
+int media_graph_filter_command(void* filter, const char* cmd, const char* arg);
+void media_graph_disconnect(void* graph, void* cookie);
+int media_graph_set_policy_status(void* graph, const char* name,
+    int number, const char* literal);
 
 int media_player_handler(void* graph, void* cookie, const char* target,
     const char* cmd, const char* arg, char* res, int res_len);
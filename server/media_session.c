@@ -49,6 +49,7 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/queue.h>
 
 #include "media_metadata.h"
@@ -96,6 +97,8 @@ static void media_session_controller_close(MediaSessionPriv* priv,
 void* media_session_controllee_register(MediaSessionPriv* priv, void* cookie);
 void media_session_controllee_notify(MediaSessionPriv* priv,
     MediaControlleePriv* controllee, int event, int result, const char* extra);
+static void media_session_controllee_changed(MediaSessionPriv* priv,
+    MediaControlleePriv* controllee);
 void media_session_controllee_update(MediaSessionPriv* priv,
     MediaControlleePriv* controllee, const char* arg);
 void media_session_controllee_unregister(MediaSessionPriv* priv,
@@ -150,8 +153,10 @@ static int media_session_controller_transfer(MediaSessionPriv* priv,
         return -ENOENT;
 
     /* Directly return metadata if query sth. */
-    if (!strcmp(cmd, "query"))
-        return media_metadata_serialize(&controllee->data, res, len);
+    if (!strcmp(cmd, "query")) {
+        ret = media_metadata_serialize(&controllee->data, res, len);
+        return ret < len ? ret : -E2BIG;
+    }
 
     /* Transfer control-message to controllee client. */
     ret = media_session_cmd2event(cmd);
@@ -183,7 +188,7 @@ void* media_session_controllee_register(MediaSessionPriv* priv, void* cookie)
     TAILQ_INSERT_TAIL(&priv->controllees, controllee, entry);
 
     /* Would notify changed event only if there are no other controllees. */
-    media_session_controllee_notify(priv, controllee, MEDIA_EVENT_CHANGED, 0, NULL);
+    media_session_controllee_changed(priv, controllee);
     return controllee;
 }
 
@@ -202,27 +207,48 @@ void media_session_controllee_notify(MediaSessionPriv* priv,
     }
 }
 
+/* Changed event carries whole metadata of the new most active controllee. */
+static void media_session_controllee_changed(MediaSessionPriv* priv,
+    MediaControlleePriv* controllee)
+{
+    char* extra = NULL;
+    int flags = 0, len;
+
+    if (controllee) {
+        flags = controllee->data.flags;
+        len = media_metadata_serialize(&controllee->data, NULL, 0) + 1;
+        extra = malloc(len);
+        if (extra)
+            media_metadata_serialize(&controllee->data, extra, len);
+    }
+
+    media_session_controllee_notify(priv, controllee,
+        MEDIA_EVENT_CHANGED, flags, extra);
+    free(extra);
+}
+
 void media_session_controllee_update(MediaSessionPriv* priv,
     MediaControlleePriv* controllee, const char* arg)
 {
-    media_metadata_t diff;
     int diff_flags;
 
-    media_metadata_init(&diff);
-    media_metadata_unserialize(&diff, arg);
-    diff_flags = diff.flags;
-    media_metadata_update(&controllee->data, &diff);
+    /* Updated event forwards the diff as is, controllers apply it
+     * without querying; a broken one makes them query again. */
+    diff_flags = media_metadata_apply(&controllee->data, arg);
+    if (diff_flags < 0) {
+        diff_flags = 0;
+        arg = NULL;
+    }
 
     /* Lastest playing controlee becomes the most active one. */
     if (controllee == TAILQ_FIRST(&priv->controllees)) {
         media_session_controllee_notify(priv, controllee,
-            MEDIA_EVENT_UPDATED, diff_flags, NULL);
+            MEDIA_EVENT_UPDATED, diff_flags, arg);
     } else if ((controllee->data.flags & MEDIA_METAFLAG_STATE)
         && controllee->data.state > 0) {
         TAILQ_REMOVE(&priv->controllees, controllee, entry);
         TAILQ_INSERT_HEAD(&priv->controllees, controllee, entry);
-        media_session_controllee_notify(priv, controllee,
-            MEDIA_EVENT_CHANGED, diff_flags, NULL);
+        media_session_controllee_changed(priv, controllee);
     }
 }
 
@@ -230,21 +256,14 @@ void media_session_controllee_unregister(MediaSessionPriv* priv,
     MediaControlleePriv* controllee)
 {
     bool changed = controllee == TAILQ_FIRST(&priv->controllees);
-    int flags = 0;
 
     media_metadata_deinit(&controllee->data);
     TAILQ_REMOVE(&priv->controllees, controllee, entry);
     free(controllee);
 
     /* Notify changed event if most active controlee was unregistered. */
-    if (changed) {
-        controllee = TAILQ_FIRST(&priv->controllees);
-        if (controllee)
-            flags = controllee->data.flags;
-
-        media_session_controllee_notify(priv, controllee,
-            MEDIA_EVENT_CHANGED, flags, NULL);
-    }
+    if (changed)
+        media_session_controllee_changed(priv, TAILQ_FIRST(&priv->controllees));
 }
 
 /****************************************************************************
@@ -24,6 +24,8 @@
 
 #include <errno.h>
 #include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "media_common.h"
@@ -132,6 +134,16 @@ void media_stub_onreceive(void* cookie, media_parcel* in, media_parcel* out)
     free(response);
 }
 
+void media_stub_onclose(void* cookie)
+{
+#ifdef CONFIG_MEDIA_FOCUS
+    media_focus_disconnect(media_get_focus(), cookie);
+#endif
+#ifdef CONFIG_LIB_FFMPEG
+    media_graph_disconnect(media_get_graph(), cookie);
+#endif
+}
+
 int media_stub_set_stream_status(const char* name, bool active)
 {
 #ifdef CONFIG_LIB_PFW
@@ -153,6 +165,32 @@ int media_stub_get_stream_name(const char* stream, char* name, int len)
 #endif
 }
 
+int media_stub_get_stream_volume(const char* stream, int* volume)
+{
+#ifdef CONFIG_LIB_PFW
+    char name[64], tmp[32];
+    int ret;
+
+    snprintf(name, sizeof(name), "%s%s", stream, MEDIA_POLICY_VOLUME);
+    ret = media_policy_handler(media_get_policy(), NULL, name, "get_int", NULL, 0, tmp, sizeof(tmp));
+    if (ret >= 0)
+        *volume = atoi(tmp);
+
+    return ret;
+#else
+    return -ENOSYS;
+#endif
+}
+
+int media_stub_set_policy_status(const char* name, int number, const char* literal)
+{
+#ifdef CONFIG_LIB_FFMPEG
+    return media_graph_set_policy_status(media_get_graph(), name, number, literal);
+#else
+    return -ENOSYS;
+#endif
+}
+
 int media_stub_process_command(const char* target,
     const char* cmd, const char* arg)
 {
@@ -162,3 +200,41 @@ int media_stub_process_command(const char* target,
     return -ENOSYS;
 #endif
 }
+
+int media_stub_find_filters(const char* target, void** filters, int nb)
+{
+#ifdef CONFIG_LIB_FFMPEG
+    return media_graph_find_filters(media_get_graph(), target, filters, nb);
+#else
+    return -ENOSYS;
+#endif
+}
+
+int media_stub_filter_command(void* filter, const char* cmd, const char* arg)
+{
+#ifdef CONFIG_LIB_FFMPEG
+    return media_graph_filter_command(filter, cmd, arg);
+#else
+    return -ENOSYS;
+#endif
+}
+
+void* media_stub_request_focus(const char* scenario, int* suggestion,
+    media_focus_callback on_suggestion, void* cookie)
+{
+#ifdef CONFIG_MEDIA_FOCUS
+    return media_focus_acquire(media_get_focus(), scenario, suggestion,
+        on_suggestion, cookie);
+#else
+    return NULL;
+#endif
+}
+
+int media_stub_abandon_focus(void* handle)
+{
+#ifdef CONFIG_MEDIA_FOCUS
+    return media_focus_release(media_get_focus(), handle);
+#else
+    return -ENOSYS;
+#endif
+}
@@ -25,6 +25,8 @@
  * Included Files
  ****************************************************************************/
 
+#include <media_defs.h>
+#include <stdatomic.h>
 #include <syslog.h>
 
 /****************************************************************************
@@ -48,6 +50,31 @@
 #define MEDIA_ID_SESSION 5
 #define MEDIA_ID_FOCUS 6
 
+/* Status page in shared memory, mediad writes, clients map read-only.
+ * Writer makes `seq` odd before updating a record and even after, so
+ * readers retry the copy if `seq` is odd or changed. */
+
+#define MEDIA_STATUS_NAME "/media_status"
+#define MEDIA_STATUS_MAGIC 0x5453444d /* "MDST" */
+#define MEDIA_STATUS_CRITERIA 8
+
+typedef struct media_status_record_s {
+    atomic_uint seq;
+    media_player_status_t data;
+} media_status_record_t;
+
+typedef struct media_status_criterion_s {
+    atomic_uint seq;
+    media_policy_status_t data;
+} media_status_criterion_t;
+
+typedef struct media_status_page_s {
+    uint32_t magic;
+    uint32_t nb;
+    media_status_criterion_t criteria[MEDIA_STATUS_CRITERIA];
+    media_status_record_t records[];
+} media_status_page_t;
+
 /* Debug log definition. */
 #define MEDIA_LOG(level, fmt, args...) \
     syslog(level, "[media][%s:%d] " fmt, __func__, __LINE__, ##args)
@@ -102,4 +129,24 @@ const char* media_id_get_name(int id);
  * @return const char* Always a printable string.
  */
 const char* media_get_cpuname(void);
+
+/**
+ * @brief Encode policy changes as the "batch" command argument.
+ *
+ * One "cmd\tname\tvalue\n" line per change, value is empty if NULL.
+ *
+ * @param changes   Changes to encode.
+ * @param nb        Number of changes.
+ * @return char* Encoded string to free, NULL on failure.
+ */
+char* media_policy_batch_encode(const media_policy_change_t* changes, int nb);
+
+/**
+ * @brief Map the status page published by mediad, read-only.
+ *
+ * Mapped once mediad has published it, kept till exit.
+ *
+ * @return const media_status_page_t* The page, NULL if unavailable.
+ */
+const media_status_page_t* media_status_get_page(void);
 #endif /* FRAMEWORKS_MEDIA_UTILS_MEDIA_COMMON_H */
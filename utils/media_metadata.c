@@ -28,6 +28,51 @@
 #include <stdlib.h>
 #include <string.h>
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Remaining buffer after `pos` bytes, snprintf only counts once it's full. */
+
+#define MEDIA_METADATA_REST(base, len, pos) \
+    ((pos) < (len) ? (base) + (pos) : NULL), ((pos) < (len) ? (len) - (pos) : 0)
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int media_metadata_append_string(char* base, int len, int pos,
+    const char* str)
+{
+    if (!str)
+        str = "";
+
+    return snprintf(MEDIA_METADATA_REST(base, len, pos), ":%zu:%s", strlen(str), str);
+}
+
+static const char* media_metadata_read_long(const char* str, long* val)
+{
+    char* end;
+
+    if (*str++ != ':')
+        return NULL;
+
+    *val = strtol(str, &end, 0);
+    return end != str ? end : NULL;
+}
+
+static const char* media_metadata_read_string(const char* str, char** val)
+{
+    long len;
+
+    str = media_metadata_read_long(str, &len);
+    if (!str || *str++ != ':' || len < 0 || strnlen(str, len) != len)
+        return NULL;
+
+    *val = strndup(str, len);
+    return *val ? str + len : NULL;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -44,6 +89,8 @@ void media_metadata_deinit(media_metadata_t* data)
         data->title = NULL;
         free(data->artist);
         data->artist = NULL;
+        free(data->album);
+        data->album = NULL;
     }
 }
 
@@ -68,6 +115,9 @@ void media_metadata_update(media_metadata_t* data, media_metadata_t* diff)
     if (diff->flags & MEDIA_METAFLAG_DURATION)
         data->duration = diff->duration;
 
+    if (diff->flags & MEDIA_METAFLAG_LATENCY)
+        data->latency = diff->latency;
+
     if (diff->flags & MEDIA_METAFLAG_TITLE) {
         free(data->title);
         data->title = diff->title;
@@ -79,31 +129,149 @@ void media_metadata_update(media_metadata_t* data, media_metadata_t* diff)
         data->artist = diff->artist;
         diff->artist = NULL;
     }
+
+    if (diff->flags & MEDIA_METAFLAG_ALBUM) {
+        free(data->album);
+        data->album = diff->album;
+        diff->album = NULL;
+    }
 }
 
 int media_metadata_serialize(const media_metadata_t* data, char* base, int len)
 {
-    /* TODO: should append these fields to parcel in need. */
-    return snprintf(base, len, "%d:%d:%d:%u:%u:%s\t%s", data->flags, data->state,
-        data->volume, data->position, data->duration, data->title, data->artist);
+    int pos;
+
+    /* Flags, then each flagged field in MEDIA_METAFLAG_* order. */
+    pos = snprintf(base, len, "%d", data->flags);
+
+    if (data->flags & MEDIA_METAFLAG_STATE)
+        pos += snprintf(MEDIA_METADATA_REST(base, len, pos), ":%d", data->state);
+
+    if (data->flags & MEDIA_METAFLAG_VOLUME)
+        pos += snprintf(MEDIA_METADATA_REST(base, len, pos), ":%d", data->volume);
+
+    if (data->flags & MEDIA_METAFLAG_POSITION)
+        pos += snprintf(MEDIA_METADATA_REST(base, len, pos), ":%u", data->position);
+
+    if (data->flags & MEDIA_METAFLAG_DURATION)
+        pos += snprintf(MEDIA_METADATA_REST(base, len, pos), ":%u", data->duration);
+
+    if (data->flags & MEDIA_METAFLAG_TITLE)
+        pos += media_metadata_append_string(base, len, pos, data->title);
+
+    if (data->flags & MEDIA_METAFLAG_ARTIST)
+        pos += media_metadata_append_string(base, len, pos, data->artist);
+
+    if (data->flags & MEDIA_METAFLAG_ALBUM)
+        pos += media_metadata_append_string(base, len, pos, data->album);
+
+    if (data->flags & MEDIA_METAFLAG_LATENCY)
+        pos += snprintf(MEDIA_METADATA_REST(base, len, pos), ":%u", data->latency);
+
+    return pos;
 }
 
 int media_metadata_unserialize(media_metadata_t* data, const char* str)
 {
-    char title[128], artist[128];
-    int ret;
+    int flags, parsed = 0;
+    long val;
+    char* end;
 
     if (!str)
         return -EINVAL;
 
-    ret = sscanf(str, "%d:%d:%d:%u:%u:%s\t%s", &data->flags, &data->state,
-        &data->volume, &data->position, &data->duration, title, artist);
+    flags = strtol(str, &end, 0);
+    if (end == str)
+        return -EINVAL;
+
+    str = end;
+
+    if (flags & MEDIA_METAFLAG_STATE) {
+        str = media_metadata_read_long(str, &val);
+        if (!str)
+            goto err;
+
+        data->state = val;
+        parsed |= MEDIA_METAFLAG_STATE;
+    }
+
+    if (flags & MEDIA_METAFLAG_VOLUME) {
+        str = media_metadata_read_long(str, &val);
+        if (!str)
+            goto err;
+
+        data->volume = val;
+        parsed |= MEDIA_METAFLAG_VOLUME;
+    }
+
+    if (flags & MEDIA_METAFLAG_POSITION) {
+        str = media_metadata_read_long(str, &val);
+        if (!str)
+            goto err;
+
+        data->position = val;
+        parsed |= MEDIA_METAFLAG_POSITION;
+    }
+
+    if (flags & MEDIA_METAFLAG_DURATION) {
+        str = media_metadata_read_long(str, &val);
+        if (!str)
+            goto err;
+
+        data->duration = val;
+        parsed |= MEDIA_METAFLAG_DURATION;
+    }
 
-    if ((data->flags & MEDIA_METAFLAG_TITLE) && title[0])
-        data->title = strdup(title);
+    if (flags & MEDIA_METAFLAG_TITLE) {
+        str = media_metadata_read_string(str, &data->title);
+        if (!str)
+            goto err;
 
-    if ((data->flags & MEDIA_METAFLAG_ARTIST) && artist[0])
-        data->artist = strdup(artist);
+        parsed |= MEDIA_METAFLAG_TITLE;
+    }
+
+    if (flags & MEDIA_METAFLAG_ARTIST) {
+        str = media_metadata_read_string(str, &data->artist);
+        if (!str)
+            goto err;
+
+        parsed |= MEDIA_METAFLAG_ARTIST;
+    }
+
+    if (flags & MEDIA_METAFLAG_ALBUM) {
+        str = media_metadata_read_string(str, &data->album);
+        if (!str)
+            goto err;
+
+        parsed |= MEDIA_METAFLAG_ALBUM;
+    }
+
+    if (flags & MEDIA_METAFLAG_LATENCY) {
+        str = media_metadata_read_long(str, &val);
+        if (!str)
+            goto err;
+
+        data->latency = val;
+        parsed |= MEDIA_METAFLAG_LATENCY;
+    }
+
+    data->flags = flags;
+    return 0;
+
+err:
+    /* Keep fields parsed before the broken one. */
+    data->flags = parsed;
+    return -EINVAL;
+}
+
+int media_metadata_apply(media_metadata_t* data, const char* str)
+{
+    media_metadata_t diff;
+    int ret;
 
-    return ret;
+    media_metadata_init(&diff);
+    ret = media_metadata_unserialize(&diff, str);
+    media_metadata_update(data, &diff);
+    media_metadata_deinit(&diff);
+    return ret < 0 ? ret : diff.flags;
 }
@@ -23,11 +23,29 @@
 
 #include <media_defs.h>
 
+/* Reply size a query starts with, doubled on -E2BIG up to the max. */
+
+#define MEDIA_METADATA_QUERY_SIZE 512
+#define MEDIA_METADATA_QUERY_MAX 16384
+
+/* Metadata is encoded as "flags" followed by ":value" of each flagged
+ * field in MEDIA_METAFLAG_* order, strings as ":length:bytes" so they
+ * may hold any character but NUL. Only flagged fields are carried, so
+ * an encoded diff applies to a full copy by `media_metadata_apply`.
+ */
+
 void media_metadata_init(media_metadata_t* data);
 void media_metadata_deinit(media_metadata_t* data);
 void media_metadata_reinit(media_metadata_t* data);
 void media_metadata_update(media_metadata_t* data, media_metadata_t* diff);
+
+/* Return length of the whole encoding like snprintf, even if truncated. */
 int media_metadata_serialize(const media_metadata_t* data, char* base, int len);
+
+/* Return zero on success, -EINVAL with fields before the broken one kept. */
 int media_metadata_unserialize(media_metadata_t* data, const char* str);
 
+/* Return flags of applied fields on success, negative errno on failure. */
+int media_metadata_apply(media_metadata_t* data, const char* str);
+
 #endif /* __FRAMEWORKS_MEDIA_UTILS_MEDIA_METADATA_H */
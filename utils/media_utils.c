@@ -23,8 +23,16 @@
  ****************************************************************************/
 
 #include <cutils/properties.h>
+#include <fcntl.h>
 #include <media_defs.h>
 #include <media_utils.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "media_common.h"
 
@@ -49,6 +57,14 @@ const char* media_event_get_name(int event)
         return "SEEKED";
     case MEDIA_EVENT_COMPLETED:
         return "COMPLETED";
+    case MEDIA_EVENT_BUFFER_LOW:
+        return "BUFFER_LOW";
+    case MEDIA_EVENT_BUFFER_HIGH:
+        return "BUFFER_HIGH";
+    case MEDIA_EVENT_SWITCHED:
+        return "SWITCHED";
+    case MEDIA_EVENT_POSITION:
+        return "POSITION";
     case MEDIA_EVENT_CHANGED:
         return "CHANGED";
     case MEDIA_EVENT_UPDATED:
@@ -103,3 +119,66 @@ const char* media_get_cpuname(void)
     return cpuname;
 #endif
 }
+
+char* media_policy_batch_encode(const media_policy_change_t* changes, int nb)
+{
+    size_t len = 1, off = 0;
+    char* str;
+    int i;
+
+    if (!changes || nb <= 0)
+        return NULL;
+
+    for (i = 0; i < nb; i++) {
+        if (!changes[i].cmd || !changes[i].name)
+            return NULL;
+
+        len += strlen(changes[i].cmd) + strlen(changes[i].name) + 3;
+        if (changes[i].value)
+            len += strlen(changes[i].value);
+    }
+
+    str = malloc(len);
+    if (!str)
+        return NULL;
+
+    for (i = 0; i < nb; i++)
+        off += snprintf(str + off, len - off, "%s\t%s\t%s\n", changes[i].cmd,
+            changes[i].name, changes[i].value ? changes[i].value : "");
+
+    return str;
+}
+
+const media_status_page_t* media_status_get_page(void)
+{
+#ifdef CONFIG_FS_SHMFS
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static const media_status_page_t* page;
+    const media_status_page_t* tmp;
+    struct stat st;
+    int fd;
+
+    pthread_mutex_lock(&lock);
+
+    if (!page) {
+        fd = shm_open(MEDIA_STATUS_NAME, O_RDONLY | O_CLOEXEC, 0);
+        if (fd >= 0) {
+            if (fstat(fd, &st) == 0 && st.st_size >= sizeof(media_status_page_t)) {
+                tmp = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (tmp != MAP_FAILED && tmp->magic == MEDIA_STATUS_MAGIC)
+                    page = tmp;
+                else if (tmp != MAP_FAILED)
+                    munmap((void*)tmp, st.st_size);
+            }
+
+            close(fd);
+        }
+    }
+
+    tmp = page;
+    pthread_mutex_unlock(&lock);
+    return tmp;
+#else
+    return NULL;
+#endif
+}